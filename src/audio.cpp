@@ -0,0 +1,234 @@
+/*
+    ww1game:   Generic WW1 game (?)
+    audio.cpp: Battle sound effects with a fixed voice budget
+
+    Copyright (C) 2022 Ángel Ruiz Fernandez
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "main.hpp"
+
+#include <cmath>
+#include <cstring>
+
+// mixer channels, what the mixer thread mixes at most whatever the battle does
+constexpr int audioVoices = 32;
+// voices one sample may hold, nearer shots take them first
+constexpr int voicesPerSound = 4;
+// shots of one sample within a window that are played as one volley instead
+constexpr int volleyShots = 6;
+constexpr Uint32 volleyWindow = 150;    // ms
+// a volley is the sample layered a few times with small offsets
+constexpr int volleyLayers = 5;
+constexpr Uint32 volleySpread = 90;     // ms between the first and last layer
+constexpr float volleyOffsets[volleyLayers] = { 0.0f, 0.23f, 0.41f, 0.67f, 1.0f };
+constexpr float volleyGains[volleyLayers] = { 1.0f, 0.8f, 0.9f, 0.7f, 0.85f };
+// pan at the screen edges, straight left or right is only reached offscreen
+constexpr float edgeAngle = 60.0f;
+// Mix_SetPosition distance at the cull distance, 255 would be silent
+constexpr float farthest = 200.0f;
+
+namespace Audio {
+    float cullDistance = 1000.0f;
+}
+
+struct AudioEvent {
+    Mix_Chunk *sound;
+    vector pos;
+    float distance;     // to the center of the screen, lower plays first
+};
+
+struct SoundState {
+    Uint32 windowStart = 0;
+    int windowShots = 0;
+    int volleyChannel = -1;             // playing this window's volley, -1 for none
+    Mix_Chunk *volley = NULL;           // premixed, NULL until first needed
+    std::vector<Sint16> volleySamples;  // owned here, Mix_QuickLoad_RAW does not copy
+    bool volleyFailed = false;          // can't premix, play the sample louder instead
+};
+
+std::vector<AudioEvent> audioEvents;
+std::unordered_map<Mix_Chunk*, SoundState> soundStates;
+Mix_Chunk *channelSounds[audioVoices] = { };    // what each channel was last started with
+float viewLeft = 0.0f, viewWidth = 0.0f;
+
+bool audioOpen = false;
+int audioFrequency = 0;
+Uint16 audioFormat = 0;
+int audioChannels = 0;
+
+void Audio::init() {
+    Mix_AllocateChannels(audioVoices);
+    audioOpen = Mix_QuerySpec(&audioFrequency, &audioFormat, &audioChannels) != 0;
+}
+
+void Audio::destroy() {
+    Mix_HaltChannel(-1);
+    for (auto& [sound, state] : soundStates)
+        if (state.volley) Mix_FreeChunk(state.volley);
+    soundStates.clear();
+    audioEvents.clear();
+    std::memset(channelSounds, 0, sizeof(channelSounds));
+}
+
+void Audio::setViewport(float left, float width) {
+    viewLeft = left;
+    viewWidth = width;
+}
+
+void Audio::fire(Mix_Chunk *sound, vector pos) {
+    if (sound == NULL || !audioOpen) return;
+    audioEvents.push_back({ sound, pos, 0.0f });
+}
+
+void Audio::forget(Mix_Chunk *sound) {
+    audioEvents.erase(std::remove_if(audioEvents.begin(), audioEvents.end(),
+        [&](const AudioEvent& event) { return event.sound == sound; }), audioEvents.end());
+
+    auto it = soundStates.find(sound);
+    Mix_Chunk *volley = it != soundStates.end() ? it->second.volley : NULL;
+    for (int ch = 0; ch < audioVoices; ch++) {
+        if (channelSounds[ch] != sound && (volley == NULL || channelSounds[ch] != volley)) continue;
+        Mix_HaltChannel(ch);
+        channelSounds[ch] = NULL;
+    }
+    if (it == soundStates.end()) return;
+    if (volley) Mix_FreeChunk(volley);
+    soundStates.erase(it);
+}
+
+// sum of offset copies of the sample, only for signed 16 bit output which is
+// what MIX_DEFAULT_FORMAT opens on every platform we build for
+Mix_Chunk* makeVolley(Mix_Chunk *sound, SoundState& state) {
+    if (audioFormat != AUDIO_S16SYS || audioChannels <= 0 || sound->alen < 2) return NULL;
+
+    const Sint16 *in = (const Sint16*)sound->abuf;
+    size_t inSamples = sound->alen / 2;
+    size_t spread = size_t(volleySpread) * audioFrequency / 1000 * audioChannels;
+    std::vector<int32_t> mix(inSamples + spread, 0);
+    for (int layer = 0; layer < volleyLayers; layer++) {
+        // whole frames so the channels stay interleaved
+        size_t offset = size_t(volleyOffsets[layer] * (spread / audioChannels)) * audioChannels;
+        int32_t gain = volleyGains[layer] * 256.0f;
+        for (size_t i = 0; i < inSamples; i++)
+            mix[offset + i] += in[i] * gain;
+    }
+
+    // independent layers add up roughly by the square root of their count
+    float scale = 1.0f / (256.0f * std::sqrt(float(volleyLayers)));
+    state.volleySamples.resize(mix.size());
+    for (size_t i = 0; i < mix.size(); i++)
+        state.volleySamples[i] = std::clamp<int32_t>(mix[i] * scale, INT16_MIN, INT16_MAX);
+
+    return Mix_QuickLoad_RAW((Uint8*)state.volleySamples.data(), state.volleySamples.size() * 2);
+}
+
+// louder the more shots the volley stands for, full volume at 16 times the threshold
+int volleyVolume(int shots) {
+    float gain = 0.5f + 0.125f * std::log2(float(shots) / volleyShots);
+    return std::min(MIX_MAX_VOLUME, int(gain * MIX_MAX_VOLUME));
+}
+
+int freeChannel() {
+    for (int ch = 0; ch < audioVoices; ch++)
+        if (!Mix_Playing(ch)) return ch;
+    return -1;
+}
+
+// pan by where x is on screen, attenuate by how far offscreen it is
+void place(int ch, float x) {
+    float half = viewWidth / 2.0f;
+    float fromCenter = x - (viewLeft + half);
+    float offscreen = std::min(1.0f, std::max(0.0f, std::abs(fromCenter) - half) / std::max(Audio::cullDistance, 1.0f));
+    float angle = offscreen > 0.0f ? edgeAngle + (90.0f - edgeAngle) * offscreen
+        : edgeAngle * std::abs(fromCenter) / std::max(half, 1.0f);
+    if (fromCenter < 0.0f) angle = 360.0f - angle;
+    float distance = farthest * offscreen;
+    Mix_SetPosition(ch, Sint16(angle) % 360, Uint8(distance));
+}
+
+int play(Mix_Chunk *chunk, int volume, float x) {
+    int ch = freeChannel();
+    if (ch < 0) return -1;
+    Mix_Volume(ch, volume);
+    place(ch, x);
+    if (Mix_PlayChannel(ch, chunk, 0) < 0) return -1;
+    channelSounds[ch] = chunk;
+    return ch;
+}
+
+int voicesOf(Mix_Chunk *sound) {
+    int voices = 0;
+    for (int ch = 0; ch < audioVoices; ch++)
+        if (channelSounds[ch] == sound && Mix_Playing(ch)) voices++;
+    return voices;
+}
+
+// once a rendered frame, whatever the ticks queued
+void Audio::update() {
+    if (audioEvents.empty()) return;
+    PROFILE_SCOPE("Audio::update");
+
+    // whatever is too far offscreen never reaches the mixer
+    float center = viewLeft + viewWidth / 2.0f;
+    float reach = viewWidth / 2.0f + Audio::cullDistance;
+    for (AudioEvent& event : audioEvents)
+        event.distance = std::abs(event.pos.x - center);
+    audioEvents.erase(std::remove_if(audioEvents.begin(), audioEvents.end(),
+        [&](const AudioEvent& event) { return event.distance > reach; }), audioEvents.end());
+    // grouped by sample, nearest first within a group
+    std::sort(audioEvents.begin(), audioEvents.end(), [](const AudioEvent& a, const AudioEvent& b) {
+        return a.sound != b.sound ? a.sound < b.sound : a.distance < b.distance;
+    });
+
+    Uint32 now = SDL_GetTicks();
+    for (size_t first = 0, last; first < audioEvents.size(); first = last) {
+        Mix_Chunk *sound = audioEvents[first].sound;
+        for (last = first; last < audioEvents.size() && audioEvents[last].sound == sound; last++) ;
+        int shots = last - first;
+
+        SoundState& state = soundStates[sound];
+        if (now - state.windowStart >= volleyWindow) {
+            state.windowStart = now;
+            state.windowShots = 0;
+            state.volleyChannel = -1;
+        }
+        state.windowShots += shots;
+
+        if (state.windowShots >= volleyShots) {
+            // one voice for the whole window, it only gets louder and
+            // follows the nearest shot
+            if (state.volley == NULL && !state.volleyFailed) {
+                state.volley = makeVolley(sound, state);
+                state.volleyFailed = state.volley == NULL;
+            }
+            Mix_Chunk *chunk = state.volley ? state.volley : sound;
+            int volume = volleyVolume(state.windowShots);
+            int ch = state.volleyChannel;
+            float x = audioEvents[first].pos.x;
+            if (ch >= 0 && channelSounds[ch] == chunk && Mix_Playing(ch)) {
+                Mix_Volume(ch, volume);
+                place(ch, x);
+            } else state.volleyChannel = play(chunk, volume, x);
+            continue;
+        }
+
+        int voices = std::min(shots, voicesPerSound - voicesOf(sound));
+        for (int i = 0; i < voices; i++)
+            if (play(sound, MIX_MAX_VOLUME, audioEvents[first + i].pos.x) < 0) break;
+    }
+
+    audioEvents.clear();
+}
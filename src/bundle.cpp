@@ -0,0 +1,186 @@
+/*
+    ww1game:    Generic WW1 game (?)
+    bundle.cpp: Memory mapped asset bundle reader
+
+    Copyright (C) 2022 Ángel Ruiz Fernandez
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "main.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const Bundle::Entry* Bundle::Reader::find(const std::string& name) const {
+    auto it = entries.find(name);
+    return it == entries.end() ? NULL : it->second;
+}
+
+// map the whole file read only, the pages are faulted in as assets are read
+const uint8_t* mapFile(const std::string& path, size_t& size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) { CloseHandle(file); return NULL; }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);   // the view keeps the mapping alive
+    size = fileSize.QuadPart;
+    return (const uint8_t*)data;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) { ::close(fd); return NULL; }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);            // the mapping stays valid
+    if (data == MAP_FAILED) return NULL;
+    size = st.st_size;
+    return (const uint8_t*)data;
+#endif
+}
+
+void unmapFile(const uint8_t *data, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+// images are wrapped in a surface with the header dimensions and maps are
+// unpacked by them, they must match the data
+bool validContents(const Bundle::Entry& entry, const uint8_t *contents) {
+    switch (entry.type) {
+    case Bundle::Entry::IMAGE:
+        return entry.width > 0 && entry.width <= INT_MAX / 4 && entry.size % 4 == 0
+            && uint64_t(entry.width) * entry.height == entry.size / 4;
+    case Bundle::Entry::PROPERTIES:
+        return entry.size == sizeof(Bundle::Properties);
+    case Bundle::Entry::MAP: {
+        uint64_t tiles = uint64_t(entry.width) * entry.height;
+        if (entry.width == 0 || entry.height == 0 || tiles >= entry.size) return false;
+        const uint8_t *headerEnd = contents + (entry.size - tiles);
+        return headerEnd[-1] == '\0' && std::count(contents, headerEnd, '\0') == Bundle::mapHeaderLines;
+    }
+    default:
+        return true;
+    }
+}
+
+bool Bundle::open(const std::string& path, Reader& reader) {
+    size_t size = 0;
+    const uint8_t *data = mapFile(path, size);
+    if (data == NULL) {
+        warning("Could not map bundle " + path);
+        return false;
+    }
+
+    // check everything the index points at lies inside the file
+    const Header *header = (const Header*)data;
+    bool valid = size >= sizeof(Header) && std::memcmp(header->magic, magic, sizeof(magic)) == 0 && header->version == version
+        && header->indexOffset <= size && (size - header->indexOffset) / sizeof(Entry) >= header->entryCount;
+    if (!valid) {
+        warning("Invalid or outdated bundle " + path);
+        unmapFile(data, size);
+        return false;
+    }
+
+    const Entry *table = (const Entry*)(data + header->indexOffset);
+    const char *names = (const char*)(table + header->entryCount);
+    size_t namesSize = size - ((const uint8_t*)names - data);
+
+    reader.data = data;
+    reader.size = size;
+    reader.entries.clear();
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const Entry& entry = table[i];
+        if (entry.offset > size || entry.size > size - entry.offset || entry.nameOffset > namesSize || entry.nameLength > namesSize - entry.nameOffset
+            || entry.type > Entry::MAP || !validContents(entry, data + entry.offset)) {
+            warning("Corrupt entry in bundle " + path);
+            close(reader);
+            return false;
+        }
+
+        reader.entries[std::string(names + entry.nameOffset, entry.nameLength)] = &entry;
+    }
+
+    return true;
+}
+
+void Bundle::close(Reader& reader) {
+    if (reader.data) unmapFile(reader.data, reader.size);
+    reader.data = NULL;
+    reader.size = 0;
+    reader.entries.clear();
+}
+
+bool Bundle::parseProperties(const std::vector<std::string>& lines, Properties& properties) {
+    if (lines.size() < 8) return false;
+    try {
+        properties.fireFrame = std::stoi(lines[0]);
+        properties.rpm = std::stof(lines[1]);
+        properties.roundDamage = std::stoi(lines[2]);
+        properties.muzzleVel = std::stof(lines[3]);
+        properties.spread = std::stof(lines[4]);
+        properties.marchSpeed = std::stof(lines[5]);
+        properties.range = std::stof(lines[6]);
+        properties.iHealth = std::stoi(lines[7]);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+void Bundle::packMap(const Assets::Map& map, Entry& entry, std::vector<uint8_t>& data) {
+    entry.type = Entry::MAP;
+    entry.width = map.width;
+    entry.height = map.height;
+    data.clear();
+    for (const std::string *line : { &map.name, &map.terrainVariantName, &map.backgroundName, &map.friendlyFactionName, &map.enemyFactionName }) {
+        data.insert(data.end(), line->begin(), line->end());
+        data.push_back('\0');
+    }
+    for (const std::string& row : map.map)
+        data.insert(data.end(), row.begin(), row.begin() + map.width);
+}
+
+// the entry was checked by open, the header holds exactly the five lines
+void Bundle::unpackMap(const Entry *entry, const uint8_t *data, Assets::Map& map) {
+    const char *text = (const char*)data;
+    for (std::string *line : { &map.name, &map.terrainVariantName, &map.backgroundName, &map.friendlyFactionName, &map.enemyFactionName }) {
+        *line = text;
+        text += line->size() + 1;
+    }
+    map.width = entry->width;
+    map.height = entry->height;
+    map.map.clear();
+    for (uint32_t y = 0; y < entry->height; y++, text += entry->width)
+        map.map.emplace_back(text, entry->width);
+}
@@ -20,21 +20,27 @@
 
 #include "main.hpp"
 
-#include <random>
 #include <algorithm>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace Game {
-    std::vector<Assets::TerrainVariant>::iterator selectedTerrainVariant;
-    std::vector<Assets::Campaign>::iterator selectedCampaign;
-    std::vector<Assets::Map>::iterator selectedMap;
+    Assets::TerrainVariantId selectedTerrainVariant = -1;
+    Assets::CampaignId selectedCampaign = -1;
+    int selectedMap = -1;
 
-    std::vector<Assets::Faction>::iterator friendlyFaction, enemyFaction;
+    Assets::FactionId friendlyFaction = -1, enemyFaction = -1;
 
-    std::vector<Soldier> friendlies, enemies;
+    Pool<Soldier> friendlies, enemies;
     std::vector<MapPathPoint> friendlyMapPath, enemyMapPath;
     std::vector<MapPathPoint>::iterator friendlyObjective, enemyObjective;
     
-    std::vector<Bullet> bullets;
+    Bullets bullets;
 
     bool gameMode = true;                                       // 1 = sandbox, 0 = against AI
     int money = 0;
@@ -44,78 +50,252 @@ namespace Game {
 
     int friendliesHoldingbjective = 0;
     int enemiesHoldingObjective = 0;
+
+    float tickRate = 60.0f;
+    long tick = 0;
+    uint32_t matchSeed = 0;
 }
 
 constexpr float gravity = 200.0f;
 
 int musicPlayingTrack = 0;
 
-std::default_random_engine randgen;
-std::normal_distribution<double> soldierGauss(1.0, 0.1);    // variation in soldier capabilities
-std::normal_distribution<double> bulletGauss(0.0, 1.0);     // aim inaccuracy
+uint32_t nextSoldierId = 0;
 
 // manipulate soldiers
-void Game::soldierSpawn(const std::vector<Assets::Character>::iterator& character, bool enemy) {
+Handle Game::soldierSpawn(Assets::CharacterId id, bool enemy) {
     Game::Soldier soldier;
-    soldier.character = character;
+    soldier.character = id;
+    const Assets::Character& character = getCharacter(id);
     if (enemy) {
         // enemy spawn point
-        soldier.pos.y = Game::enemyMapPath[Game::enemyMapPath.size() - 1].pos.y - soldier.character->size.y;
-        soldier.pos.x = Game::enemyMapPath[Game::enemyMapPath.size() - 1].pos.x - (soldier.character->size.x / 2.0f) - 1.0f;
+        soldier.pos.y = Game::enemyMapPath[Game::enemyMapPath.size() - 1].pos.y - character.size.y;
+        soldier.pos.x = Game::enemyMapPath[Game::enemyMapPath.size() - 1].pos.x - (character.size.x / 2.0f) - 1.0f;
         soldier.friendly = false;
+        soldier.pathIndex = Game::enemyMapPath.size() - 2;
     } else {
         // friendly spawn point
-        soldier.pos.y = Game::friendlyMapPath[0].pos.y - soldier.character->size.y;
-        soldier.pos.x = Game::friendlyMapPath[0].pos.x - (soldier.character->size.x / 2.0f) + 1.0f;
+        soldier.pos.y = Game::friendlyMapPath[0].pos.y - character.size.y;
+        soldier.pos.x = Game::friendlyMapPath[0].pos.x - (character.size.x / 2.0f) + 1.0f;
         soldier.friendly = true;
+        soldier.pathIndex = 1;
     }
+    soldier.prevPos = soldier.pos;
     soldier.vel = { 0.0f, 0.0f };
     soldier.state = Game::Soldier::MARCHING;
+    soldier.animTime = 0.0f;
     soldier.frameCounter = 0;
     soldier.cooldownTime = 0.0f;
-    soldier.rand = soldierGauss(randgen);
-    soldier.health = soldier.character->iHealth;
+    soldier.id = nextSoldierId++;
+    // variation in soldier capabilities
+    soldier.rand = 1.0f + 0.1f * Random::gauss(Game::matchSeed, soldier.id, 0, Random::SOLDIER_VARIATION);
+    soldier.health = character.iHealth;
 
     if (enemy)
-        Game::enemies.push_back(soldier);
+        return Game::enemies.add(soldier);
     else
-        Game::friendlies.push_back(soldier);
+        return Game::friendlies.add(soldier);
 }
 
-void Game::soldierDeath(const std::vector<Game::Soldier>::iterator& soldier) {
-    if (soldier->state == Game::Soldier::DYING) return;
-    soldier->state = Game::Soldier::DYING;
-    soldier->frameCounter = 0;
+void Game::soldierDeath(Game::Soldier& soldier) {
+    if (soldier.state == Game::Soldier::DYING) return;
+    soldier.state = Game::Soldier::DYING;
+    soldier.animTime = 0.0f;
+    soldier.frameCounter = 0;
 
     // enemy or friendly... improve this
-    if (soldier->friendly) Game::friendlyCasualties++;
+    if (soldier.friendly) Game::friendlyCasualties++;
     else Game::enemyCasualties++;
 }
 
-void Game::soldierFire(const std::vector<Game::Soldier>::iterator& soldier) {
-    if (soldier->state == Game::Soldier::DYING) return;
-    if (soldier->state == Game::Soldier::FIRING) return;
-    soldier->prevState = soldier->state;
-    soldier->state = Game::Soldier::FIRING;
-    soldier->frameCounter = 0;
+void Game::seed(unsigned int seed) {
+    Game::matchSeed = seed;
+}
+
+void Game::soldierFire(Game::Soldier& soldier) {
+    if (soldier.state == Game::Soldier::DYING) return;
+    if (soldier.state == Game::Soldier::FIRING) return;
+    soldier.prevState = soldier.state;
+    soldier.state = Game::Soldier::FIRING;
+    soldier.animTime = 0.0f;
+    soldier.frameCounter = 0;
+}
+
+// order a side to leave its current trench and march to the next one
+void Game::advance(bool enemy) {
+    if (enemy) {
+        for (int i = Game::enemyMapPath.size() - 1; i >= 0; i--) {
+            auto& p = Game::enemyMapPath[i];
+            if (p.action == Game::MapPathPoint::HOLD) {
+                if (Game::enemyObjective != (Game::enemyMapPath.begin() + i))
+                    p.action = Game::MapPathPoint::MARCH;
+                break;
+            }
+        }
+    } else {
+        for (int i = 0; i < Game::friendlyMapPath.size(); i++) {
+            auto& p = Game::friendlyMapPath[i];
+            if (p.action == Game::MapPathPoint::HOLD) {
+                if (Game::friendlyObjective != (Game::friendlyMapPath.begin() + i))
+                    p.action = Game::MapPathPoint::MARCH;
+                break;
+            }
+        }
+    }
 }
 
 // manipulate bullets
 void bulletSpawn(vector pos, vector vel, int damage, bool fromEnemy) {
-    Game::Bullet bullet;
-    bullet.pos = pos;
-    bullet.vel = vel;
-    bullet.damage = damage;
-    bullet.fromEnemy = fromEnemy;
-    Game::bullets.push_back(bullet);
+    Game::bullets.add(pos, vel, damage, fromEnemy);
+}
+
+void Game::Bullets::add(vector pos, vector vel, int damage, bool fromEnemy) {
+    x.push_back(pos.x); y.push_back(pos.y);
+    vx.push_back(vel.x); vy.push_back(vel.y);
+    prevX.push_back(pos.x); prevY.push_back(pos.y);
+    this->damage.push_back(damage);
+    this->fromEnemy.push_back(fromEnemy);
+    removed.push_back(false);
+}
+
+void Game::Bullets::remove(size_t i) {
+    if (removed[i]) return;
+    removed[i] = true;
+    pending.push_back(i);
+}
+
+void Game::Bullets::compact() {
+    // highest index first, so the last bullet moved into a hole is never itself pending
+    std::sort(pending.begin(), pending.end(), [](size_t a, size_t b) { return a > b; });
+    for (size_t i : pending) {
+        size_t last = size() - 1;
+        if (i != last) {
+            x[i] = x[last]; y[i] = y[last];
+            vx[i] = vx[last]; vy[i] = vy[last];
+            prevX[i] = prevX[last]; prevY[i] = prevY[last];
+            damage[i] = damage[last];
+            fromEnemy[i] = fromEnemy[last];
+            removed[i] = removed[last];
+        }
+        x.pop_back(); y.pop_back();
+        vx.pop_back(); vy.pop_back();
+        prevX.pop_back(); prevY.pop_back();
+        damage.pop_back();
+        fromEnemy.pop_back();
+        removed.pop_back();
+    }
+    pending.clear();
+}
+
+void Game::Bullets::clear() {
+    x.clear(); y.clear();
+    vx.clear(); vy.clear();
+    prevX.clear(); prevY.clear();
+    damage.clear();
+    fromEnemy.clear();
+    removed.clear();
+    pending.clear();
+}
+
+void Game::Bullets::integrateScalar(float deltaTime, float minX, float maxX) {
+    // last tick's positions become prevX/prevY by swapping, copying them
+    // was a third of the loop's memory traffic
+    x.swap(prevX); y.swap(prevY);
+    size_t n = size();
+    float *__restrict px = x.data(), *__restrict py = y.data();
+    const float *__restrict ppx = prevX.data(), *__restrict ppy = prevY.data();
+    const float *__restrict pvx = vx.data(), *__restrict pvy = vy.data();
+    for (size_t i = 0; i < n; i++) {
+        px[i] = ppx[i] + pvx[i] * deltaTime;
+        py[i] = ppy[i] + pvy[i] * deltaTime;
+        if (px[i] < minX || px[i] > maxX) remove(i);
+    }
+}
+
+void Game::Bullets::integrate(float deltaTime, float minX, float maxX) {
+    x.swap(prevX); y.swap(prevY);
+    size_t n = size(), i = 0;
+    float *px = x.data(), *py = y.data(), *pvx = vx.data(), *pvy = vy.data();
+    float *ppx = prevX.data(), *ppy = prevY.data();
+
+    // mul then add, no fma, so every path rounds like the scalar one
+#if defined(__AVX2__)
+    __m256 dt8 = _mm256_set1_ps(deltaTime), min8 = _mm256_set1_ps(minX), max8 = _mm256_set1_ps(maxX);
+    for (; i + 8 <= n; i += 8) {
+        __m256 bx = _mm256_add_ps(_mm256_loadu_ps(ppx + i), _mm256_mul_ps(_mm256_loadu_ps(pvx + i), dt8));
+        __m256 by = _mm256_add_ps(_mm256_loadu_ps(ppy + i), _mm256_mul_ps(_mm256_loadu_ps(pvy + i), dt8));
+        _mm256_storeu_ps(px + i, bx);
+        _mm256_storeu_ps(py + i, by);
+
+        __m256 out = _mm256_or_ps(_mm256_cmp_ps(bx, min8, _CMP_LT_OQ), _mm256_cmp_ps(bx, max8, _CMP_GT_OQ));
+        int mask = _mm256_movemask_ps(out);
+        for (int k = 0; mask; k++, mask >>= 1)
+            if (mask & 1) remove(i + k);
+    }
+#elif defined(__SSE2__)
+    __m128 dt4 = _mm_set1_ps(deltaTime), min4 = _mm_set1_ps(minX), max4 = _mm_set1_ps(maxX);
+    for (; i + 4 <= n; i += 4) {
+        __m128 bx = _mm_add_ps(_mm_loadu_ps(ppx + i), _mm_mul_ps(_mm_loadu_ps(pvx + i), dt4));
+        __m128 by = _mm_add_ps(_mm_loadu_ps(ppy + i), _mm_mul_ps(_mm_loadu_ps(pvy + i), dt4));
+        _mm_storeu_ps(px + i, bx);
+        _mm_storeu_ps(py + i, by);
+
+        __m128 out = _mm_or_ps(_mm_cmplt_ps(bx, min4), _mm_cmpgt_ps(bx, max4));
+        int mask = _mm_movemask_ps(out);
+        for (int k = 0; mask; k++, mask >>= 1)
+            if (mask & 1) remove(i + k);
+    }
+#endif
+
+    // tail, or everything without SIMD
+    for (; i < n; i++) {
+        px[i] = ppx[i] + pvx[i] * deltaTime;
+        py[i] = ppy[i] + pvy[i] * deltaTime;
+        if (px[i] < minX || px[i] > maxX) remove(i);
+    }
 }
 
+// per tile column range of map path segments, so terrain queries only look
+// at the columns a ray spans instead of the whole map
+struct TerrainIndex {
+    float originX;
+    std::vector<int> columnFirst, columnLast;   // first and last segment touching each column
+
+    int columnOf(float x) const {
+        return std::clamp(int(std::floor((x - originX) / TILE_SIZE)), 0, int(columnFirst.size()) - 1);
+    }
+
+    void build(const std::vector<Game::MapPathPoint>& path) {
+        originX = path[0].pos.x;
+        int columns = int((path[path.size() - 1].pos.x - originX) / TILE_SIZE) + 1;
+        columnFirst.assign(columns, int(path.size()));
+        columnLast.assign(columns, -1);
+
+        // the last segment, towards the enemy spawn, never collides
+        for (int i = 0; i < int(path.size()) - 2; i++) {
+            for (int c = columnOf(path[i].pos.x); c <= columnOf(path[i + 1].pos.x); c++) {
+                columnFirst[c] = std::min(columnFirst[c], i);
+                columnLast[c] = std::max(columnLast[c], i);
+            }
+        }
+
+        // columns past the ends have no segments, let ranges run through them
+        for (int c = 1; c < columns; c++)
+            columnLast[c] = std::max(columnLast[c], columnLast[c - 1]);
+        for (int c = columns - 2; c >= 0; c--)
+            columnFirst[c] = std::min(columnFirst[c], columnFirst[c + 1]);
+    }
+};
+
+TerrainIndex terrainIndex;
+
 // build a vector of points from map
 void findMapPath() {
+    const Assets::Map& map = getSelectedMap();
     int prevmy = 0;
-    for (int mx = 0; mx < Game::selectedMap->width; mx++) {
+    for (int mx = 0; mx < map.width; mx++) {
         int my = 0;
-        while (Game::selectedMap->map[my][mx] == ' ') { my++; }
+        while (map.map[my][mx] == ' ') { my++; }
 
         Game::MapPathPoint point;
         point.type = Game::MapPathPoint::GROUND;    // when GROUND, action is ignored
@@ -131,7 +311,7 @@ void findMapPath() {
             Game::friendlyMapPath.push_back(point);
         }
 
-        if (Game::selectedMap->map[my][mx] == 't') {
+        if (map.map[my][mx] == 't') {
             point.type = Game::MapPathPoint::TRENCH;
             point.action = Game::MapPathPoint::HOLD;
             point.pos = {float((TILE_SIZE * mx) + (TILE_SIZE / 2)), float(TILE_SIZE * (my + 1))};
@@ -153,6 +333,8 @@ void findMapPath() {
     // copy friendly path to enemy path, they are the same
     Game::enemyMapPath = Game::friendlyMapPath;
 
+    terrainIndex.build(Game::friendlyMapPath);
+
     // get objectives
     for (int i = Game::friendlyMapPath.size() - 1; i >= 0; i--) {
         if (Game::friendlyMapPath[i].type == Game::MapPathPoint::TRENCH) {
@@ -202,7 +384,10 @@ bool doIntersect(vector p1, vector q1, vector p2, vector q2) {
 }
 
 bool intersectsMap(const vector& a, const vector& b) {
-    for (int i = 0; i < Game::friendlyMapPath.size() - 2; i++) {
+    // the path is x-monotone, so the segments the ray can touch are contiguous
+    int first = terrainIndex.columnFirst[terrainIndex.columnOf(std::min(a.x, b.x))];
+    int last = terrainIndex.columnLast[terrainIndex.columnOf(std::max(a.x, b.x))];
+    for (int i = first; i <= last; i++) {
         if (doIntersect(a, b, Game::friendlyMapPath[i].pos, Game::friendlyMapPath[i + 1].pos)) {
             return true;
         }
@@ -210,63 +395,374 @@ bool intersectsMap(const vector& a, const vector& b) {
     return false;
 }
 
+// static line of sight over the terrain. The ground is solid under the
+// x-monotone path, so a ray between two points above it is clear iff it
+// passes above every path point in between. For every quantized source
+// point and every column within reach the table keeps the horizon: the
+// lowest y still visible there
+constexpr int losCell = TILE_SIZE / 2;
+
+struct LosTable {
+    float originX, originY;
+    int cols = 0, rows = 0, reach = 0;
+    std::vector<float> lowestVisible;       // [col][row][reach + dCol], NaN if the source cell touches the ground
+
+    int index(int col, int row, int dCol) const {
+        return ((col * rows) + row) * (2 * reach + 1) + reach + dCol;
+    }
+
+    // 1 clear, 0 blocked, -1 not covered by the table
+    int lookup(const vector& a, const vector& b) const {
+        int col = int(std::floor((a.x - originX) / losCell));
+        int row = int(std::floor((a.y - originY) / losCell));
+        int dCol = int(std::floor((b.x - originX) / losCell)) - col;
+        if (col < 0 || col >= cols || row < 0 || row >= rows || dCol < -reach || dCol > reach) return -1;
+        float visible = lowestVisible[index(col, row, dCol)];
+        if (std::isnan(visible)) return -1;
+        return b.y < visible;
+    }
+
+    void build(const std::vector<Game::MapPathPoint>& path, float maxReach, float maxHeight) {
+        originX = path[0].pos.x;
+        float minY = path[0].pos.y;
+        for (const Game::MapPathPoint& p : path) minY = std::min(minY, p.pos.y);
+        originY = std::floor((minY - maxHeight) / losCell) * losCell - losCell;
+
+        float maxY = path[0].pos.y;
+        for (const Game::MapPathPoint& p : path) maxY = std::max(maxY, p.pos.y);
+        cols = int((path[path.size() - 1].pos.x - originX) / losCell) + 1;
+        rows = int((maxY - originY) / losCell) + 1;
+        reach = int(std::ceil(maxReach / losCell)) + 1;
+        lowestVisible.assign(size_t(cols) * rows * (2 * reach + 1), std::numeric_limits<float>::quiet_NaN());
+
+        // ground at every column center, and the highest anywhere in the column.
+        // Columns and the path both go left to right, so one cursor walks the
+        // segments; where the path steps vertically the highest point counts
+        std::vector<float> ground(cols), groundTop(cols);
+        int segment = 0;
+        auto groundAt = [&](float x) {
+            while (segment + 1 < path.size() && path[segment + 1].pos.x < x) segment++;
+            float y = maxY;
+            for (int k = segment; k + 1 < path.size() && path[k].pos.x <= x; k++) {
+                const vector& p0 = path[k].pos;
+                const vector& p1 = path[k + 1].pos;
+                if (x > p1.x) continue;
+                y = std::min(y, p1.x > p0.x ? p0.y + (p1.y - p0.y) * (x - p0.x) / (p1.x - p0.x) : std::min(p0.y, p1.y));
+            }
+            return y;
+        };
+        int point = 0;
+        for (int c = 0; c < cols; c++) {
+            float left = originX + c * losCell, right = left + losCell;
+            float leftGround = groundAt(left);
+            ground[c] = groundAt(left + losCell / 2.0f);
+            groundTop[c] = std::min({ ground[c], leftGround, groundAt(right) });
+            while (point < path.size() && path[point].pos.x <= left) point++;
+            for (int k = point; k < path.size() && path[k].pos.x < right; k++)
+                groundTop[c] = std::min(groundTop[c], path[k].pos.y);
+        }
+
+        auto pointX = [](const Game::MapPathPoint& p, float x) { return p.pos.x < x; };
+        for (int col = 0; col < cols; col++) {
+            // first path point right of the column center, and last one left of it, the same for every row
+            float centerX = originX + (col + 0.5f) * losCell;
+            int firstRight = std::upper_bound(path.begin(), path.end(), centerX, [](float x, const Game::MapPathPoint& p) { return x < p.pos.x; }) - path.begin();
+            int lastLeft = int(std::lower_bound(path.begin(), path.end(), centerX, pointX) - path.begin()) - 1;
+
+            for (int row = 0; row < rows; row++) {
+                // a muzzle anywhere in the cell, its bottom edge included, could be at or inside
+                // the ground (a trench lip), leave those to intersectsMap
+                if (originY + (row + 1) * losCell >= groundTop[col]) continue;
+                vector src = { originX + (col + 0.5f) * losCell, originY + (row + 0.5f) * losCell };
+
+                lowestVisible[index(col, row, 0)] = ground[col];
+
+                // sweep right then left, the horizon is the flattest slope to a path point passed so far
+                for (int dir : { 1, -1 }) {
+                    int i = dir > 0 ? firstRight : lastLeft;
+
+                    bool horizon = false;
+                    float minSlope = 0.0f;
+                    for (int dCol = 1; dCol <= reach; dCol++) {
+                        int c = col + dir * dCol;
+                        if (c < 0 || c >= cols) break;
+                        float x = originX + (c + 0.5f) * losCell;
+                        for (; i >= 0 && i < path.size() && (dir > 0 ? path[i].pos.x < x : path[i].pos.x > x); i += dir) {
+                            float slope = (path[i].pos.y - src.y) / std::abs(path[i].pos.x - src.x);
+                            if (!horizon || slope < minSlope) minSlope = slope;
+                            horizon = true;
+                        }
+
+                        float visible = ground[c];
+                        if (horizon) visible = std::min(visible, src.y + minSlope * std::abs(x - src.x));
+                        lowestVisible[index(col, row, dir * dCol)] = visible;
+                    }
+                }
+            }
+        }
+    }
+};
+
+LosTable losTable;
+
+// table lookup, exact intersection only for rays the table doesn't cover
+bool losBlocked(const vector& a, const vector& b) {
+    int clear = losTable.lookup(a, b);
+    return clear < 0 ? intersectsMap(a, b) : !clear;
+}
+
 // ============== game itself ==============
 void Game::mapSetup() {
     findMapPath();
-    Game::selectedTerrainVariant = getTerrainVariantByName(Game::selectedMap->terrainVariantName);
-    Game::friendlyFaction = getFactionByName(Game::selectedMap->friendlyFactionName);
-    Game::enemyFaction = getFactionByName(Game::selectedMap->enemyFactionName);
+    Game::tick = 0;
+    nextSoldierId = 0;
+    Game::selectedTerrainVariant = getSelectedMap().terrainVariant;
+    Game::friendlyFaction = getSelectedMap().friendlyFaction;
+    Game::enemyFaction = getSelectedMap().enemyFaction;
+    Assets::acquireMap(getSelectedMap());
+
+    // reach covers soldier.rand up to 5 sigma, longer shots fall back to intersectsMap
+    float maxReach = 0.0f, maxHeight = 0.0f;
+    for (Assets::FactionId faction : { Game::friendlyFaction, Game::enemyFaction }) {
+        if (faction < 0) continue;
+        for (const Assets::Character& character : getFaction(faction).characters) {
+            maxReach = std::max(maxReach, 1.5f * character.range * TILE_SIZE);
+            maxHeight = std::max(maxHeight, character.size.y);
+        }
+    }
+    losTable.build(Game::friendlyMapPath, maxReach, maxHeight);
+}
+
+// leave nothing of the match behind, and let go of its assets
+void Game::mapTeardown() {
+    Game::friendlies.clear();
+    Game::enemies.clear();
+    Game::bullets.clear();
+    Game::friendlyMapPath.clear();
+    Game::enemyMapPath.clear();
+    Game::friendlyCasualties = 0;
+    Game::enemyCasualties = 0;
+    Assets::releaseMap(getSelectedMap());
 }
 
-void updateBullets(float deltaTime) {
-    for (auto it = Game::bullets.begin(); it < Game::bullets.end(); it++) {
-        Game::Bullet& bullet = *it;
-        vector b1 = bullet.pos;     // get travel segment
-        bullet.pos += bullet.vel * deltaTime;
-        vector b2 = bullet.pos;
+// uniform grid over the soldiers of one side, one tile per cell, so a bullet
+// only tests the soldiers in the columns its travel segment crosses, and in
+// a crowded column (a trench) only the ones at its height. A soldier is in
+// every column it spans, in the row of its top
+struct SoldierGrid {
+    float originX;
+    int cols, rows;
+    float maxHeight;                // tallest soldier, how far above a bullet a box can start
+    std::vector<int> cellStart;     // offsets into items, cols * rows + 1, row major within a column
+    std::vector<int> items;         // soldier indices grouped by cell
+    std::vector<int> cellFill;
+
+    int colOf(float x) const {
+        return std::clamp(int(std::floor((x - originX) / TILE_SIZE)), 0, cols - 1);
+    }
+
+    int rowOf(float y) const {
+        return std::clamp(int(std::floor(y / TILE_SIZE)), 0, rows - 1);
+    }
 
-        // if out of the map
-        if (bullet.pos.x < 0.0f || bullet.pos.x > Game::friendlyMapPath[Game::friendlyMapPath.size() - 1].pos.x) { Game::bullets.erase(it); continue; }
+    void build(const Pool<Game::Soldier>& soldiers) {
+        originX = Game::friendlyMapPath[0].pos.x;
+        cols = int((Game::friendlyMapPath[Game::friendlyMapPath.size() - 1].pos.x - originX) / TILE_SIZE) + 1;
+        rows = std::max(1, getSelectedMap().height);
+        maxHeight = 0.0f;
 
-        // map collision, intersect travel segment with all map segments
-        if (intersectsMap(b1, b2)) {
-            Game::bullets.erase(it);
+        // count soldiers per cell, a soldier wider than a tile is in several
+        cellStart.assign(cols * rows + 1, 0);
+        for (const Game::Soldier& soldier : soldiers) {
+            if (soldier.state == Game::Soldier::DYING) continue;
+            const vector& size = getCharacter(soldier.character).size;
+            maxHeight = std::max(maxHeight, size.y);
+            int row = rowOf(soldier.pos.y);
+            for (int c = colOf(soldier.pos.x); c <= colOf(soldier.pos.x + size.x); c++)
+                cellStart[c * rows + row + 1]++;
+        }
+
+        for (int cell = 0; cell < cols * rows; cell++)
+            cellStart[cell + 1] += cellStart[cell];
+
+        items.resize(cellStart[cols * rows]);
+        cellFill.assign(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < soldiers.size(); i++) {
+            const Game::Soldier& soldier = soldiers[i];
+            if (soldier.state == Game::Soldier::DYING) continue;
+            int row = rowOf(soldier.pos.y);
+            for (int c = colOf(soldier.pos.x); c <= colOf(soldier.pos.x + getCharacter(soldier.character).size.x); c++)
+                items[cellFill[c * rows + row]++] = i;
+        }
+    }
+
+    // items of a column whose box can reach into [yMin, yMax], the rows are contiguous
+    std::pair<int, int> span(int col, float yMin, float yMax) const {
+        return { cellStart[col * rows + rowOf(yMin - maxHeight)], cellStart[col * rows + rowOf(yMax) + 1] };
+    }
+};
+
+SoldierGrid friendlyGrid, enemyGrid;
+
+// fraction of the segment a-b where it enters the box, or -1 if it misses
+float segmentEntersBox(const vector& a, const vector& b, const vector& min, const vector& max) {
+    float t0 = 0.0f, t1 = 1.0f;
+    float d[2] = { b.x - a.x, b.y - a.y };
+    float o[2] = { a.x, a.y };
+    float lo[2] = { min.x, min.y };
+    float hi[2] = { max.x, max.y };
+
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0.0f) {
+            if (o[axis] <= lo[axis] || o[axis] >= hi[axis]) return -1.0f;
             continue;
         }
+        float ta = (lo[axis] - o[axis]) / d[axis];
+        float tb = (hi[axis] - o[axis]) / d[axis];
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        if (t0 > t1) return -1.0f;
+    }
+    return t0;
+}
 
-        // soldier collision, no friendly fire
-        if (bullet.fromEnemy) {
-            for (Game::Soldier& soldier : Game::friendlies)
-                if ((soldier.state != Game::Soldier::DYING) && (bullet.pos.x > soldier.pos.x) && (bullet.pos.y > soldier.pos.y) && (bullet.pos.x < soldier.pos.x + soldier.character->size.x) && (bullet.pos.y < soldier.pos.y + soldier.character->size.y)) {
-                    soldier.health -= bullet.damage;
-                    Game::bullets.erase(it); break;
-                }
-        } else {
-            for (Game::Soldier& soldier : Game::enemies)
-                if ((soldier.state != Game::Soldier::DYING) && (bullet.pos.x > soldier.pos.x) && (bullet.pos.y > soldier.pos.y) && (bullet.pos.x < soldier.pos.x + soldier.character->size.x) && (bullet.pos.y < soldier.pos.y + soldier.character->size.y)) {
-                    soldier.health -= bullet.damage;
-                    Game::bullets.erase(it); break;
+// hits and removals found by one chunk of bullets, applied serially
+struct BulletChunk {
+    std::vector<std::pair<Game::Soldier*, int>> hits;
+    std::vector<size_t> removed;
+};
+
+constexpr int bulletChunk = 1024;
+std::vector<BulletChunk> bulletChunks;
+
+void Game::updateBullets(float deltaTime) {
+    PROFILE_SCOPE("updateBullets");
+    friendlyGrid.build(Game::friendlies);
+    enemyGrid.build(Game::enemies);
+
+    // move everything and drop what left the map
+    Game::Bullets& bullets = Game::bullets;
+    bullets.integrate(deltaTime, 0.0f, Game::friendlyMapPath[Game::friendlyMapPath.size() - 1].pos.x);
+
+    // health isn't read here, so deferring the damage to the merge changes nothing
+    int chunks = (bullets.size() + bulletChunk - 1) / bulletChunk;
+    if (bulletChunks.size() < chunks) bulletChunks.resize(chunks);
+
+    Jobs::parallelFor(chunks, [&](int chunk) {
+        PROFILE_SCOPE("updateBullets chunk");
+        BulletChunk& out = bulletChunks[chunk];
+        out.hits.clear();
+        out.removed.clear();
+
+        size_t last = std::min(bullets.size(), size_t(chunk + 1) * bulletChunk);
+        for (size_t i = size_t(chunk) * bulletChunk; i < last; i++) {
+            if (bullets.isRemoved(i)) continue;
+            vector b1 = bullets.prevPos(i);     // travel segment
+            vector b2 = bullets.pos(i);
+
+            // map collision, intersect travel segment with all map segments
+            if (intersectsMap(b1, b2)) {
+                out.removed.push_back(i);
+                continue;
+            }
+
+            // soldier collision, no friendly fire, cells are walked in the travel direction
+            const SoldierGrid& grid = bullets.fromEnemy[i] ? friendlyGrid : enemyGrid;
+            Pool<Game::Soldier>& targets = bullets.fromEnemy[i] ? Game::friendlies : Game::enemies;
+
+            Game::Soldier *hit = nullptr;
+            int cellFirst = grid.colOf(b1.x), cellLast = grid.colOf(b2.x);
+            int step = cellLast >= cellFirst ? 1 : -1;
+            float yMin = std::min(b1.y, b2.y), yMax = std::max(b1.y, b2.y);
+            for (int c = cellFirst; !hit; c += step) {
+                auto [first, last] = grid.span(c, yMin, yMax);
+                for (int k = first; k < last; k++) {
+                    Game::Soldier& soldier = targets[grid.items[k]];
+                    if (segmentEntersBox(b1, b2, soldier.pos, soldier.pos + getCharacter(soldier.character).size) >= 0.0f) { hit = &soldier; break; }
                 }
+                if (c == cellLast) break;
+            }
+
+            if (hit) {
+                out.hits.push_back({ hit, bullets.damage[i] });
+                out.removed.push_back(i);
+            }
         }
+    });
+
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        for (auto& hit : bulletChunks[chunk].hits) hit.first->health -= hit.second;
+        for (size_t i : bulletChunks[chunk].removed) bullets.remove(i);
     }
 }
 
-auto findNearestTarget(const Game::Soldier& soldier, const std::vector<Game::Soldier>& targetEnemies) {
-    auto nearestEnemy = targetEnemies.end();
-    for (auto it = targetEnemies.begin(); it < targetEnemies.end(); it++) {
-        const Game::Soldier& enemy = *it;
-        if (abs(enemy.pos.x - soldier.pos.x) < soldier.rand * soldier.character->range * TILE_SIZE) {
-            if (nearestEnemy == targetEnemies.end()) { nearestEnemy = it; continue; }
-            if (abs(enemy.pos.x - soldier.pos.x) < abs(nearestEnemy->pos.x - soldier.pos.x)) { nearestEnemy = it; continue; }
+// snapshot of one side sorted by x, taken before the factions update. The
+// nearest target is a binary search, and both sides can update at the same
+// time reading the other as it was at the start of the tick
+struct TargetIndex {
+    struct Entry {
+        float x;
+        int index;
+        vector pos, size;
+        bool operator<(const Entry& right) const { return x < right.x || (x == right.x && index < right.index); }
+    };
+    std::vector<Entry> entries;
+
+    void build(const Pool<Game::Soldier>& soldiers) {
+        entries.clear();
+        for (int i = 0; i < soldiers.size(); i++)
+            if (!soldiers.isRemoved(i)) entries.push_back({ soldiers[i].pos.x, i, soldiers[i].pos, getCharacter(soldiers[i].character).size });
+        std::sort(entries.begin(), entries.end());
+    }
+
+    // soldier nearest to x closer than range, ties go to the lowest index, or nullptr
+    const Entry* nearest(float x, float range) const {
+        auto right = std::lower_bound(entries.begin(), entries.end(), x, [](const Entry& e, float x) { return e.x < x; });
+        const Entry *best = nullptr;
+        float bestDist = 0.0f;
+
+        // lowest index of the run with the same x is the first one
+        if (right != entries.end()) {
+            best = &*right;
+            bestDist = right->x - x;
+        }
+
+        if (right != entries.begin()) {
+            float leftX = (right - 1)->x;
+            auto left = std::lower_bound(entries.begin(), right, leftX, [](const Entry& e, float x) { return e.x < x; });
+            float dist = x - leftX;
+            if (!best || dist < bestDist || (dist == bestDist && left->index < best->index)) {
+                best = &*left;
+                bestDist = dist;
+            }
         }
+
+        return best && bestDist < range ? best : nullptr;
+    }
+};
+
+TargetIndex friendlyTargets, enemyTargets;
+
+void resetTrenches(Pool<Game::Soldier>& soldiers) {
+    // soldiers removed this tick are still in the pool until it is compacted
+    bool friendly = &soldiers == &Game::friendlies;
+
+    // find leftmost and rightmost soldiers
+    float minx = getSelectedMap().width * TILE_SIZE;
+    float maxx = 0.0f;
+    const Game::Soldier *leftmost = nullptr, *rightmost = nullptr;
+    int alive = 0;
+    for (int i = 0; i < soldiers.size(); i++) {
+        if (soldiers.isRemoved(i)) continue;
+        alive++;
+        if (soldiers[i].pos.x < minx) { minx = soldiers[i].pos.x; leftmost = &soldiers[i]; }
+        if (soldiers[i].pos.x > maxx) { maxx = soldiers[i].pos.x; rightmost = &soldiers[i]; }
     }
-    return nearestEnemy;
-}
 
-void resetTrenches(std::vector<Game::Soldier>& soldiers) {
-    // if soldiers is empty we can't check the side of the soldiers themselves
-    if (soldiers.size() < 1) {
-        if (soldiers.data() == Game::friendlies.data()) {
+    // nobody left, every trench goes back to hold
+    if (alive < 1) {
+        if (friendly) {
             for (int i = 0; i < Game::friendlyMapPath.size(); i++)
                 if (Game::friendlyMapPath[i].type == Game::MapPathPoint::TRENCH)
                     if (Game::friendlyMapPath[i].action != Game::MapPathPoint::HOLD)
@@ -281,161 +777,267 @@ void resetTrenches(std::vector<Game::Soldier>& soldiers) {
         return;
     }
 
-    // find leftmost and rightmost soldiers
-    float minx = Game::selectedMap->width * TILE_SIZE;
-    float maxx = 0.0f;
-    std::vector<Game::Soldier>::iterator leftmost = soldiers.end();
-    std::vector<Game::Soldier>::iterator rightmost = soldiers.end();
-    for (int i = 0; i < soldiers.size(); i++) {
-        if (soldiers[i].pos.x < minx) { minx = soldiers[i].pos.x; leftmost = soldiers.begin() + i; }
-        if (soldiers[i].pos.x > maxx) { maxx = soldiers[i].pos.x; rightmost = soldiers.begin() + i; }
-    }
-
     // if there are trenches on clear more advanced than the most advanced soldier, reset it
-    if (soldiers[0].friendly) {
-        if (rightmost != soldiers.end())
+    if (friendly) {
+        if (rightmost)
             for (int i = 0; i < Game::friendlyMapPath.size(); i++)
                 if (Game::friendlyMapPath[i].type == Game::MapPathPoint::TRENCH)
                     if (Game::friendlyMapPath[i].action != Game::MapPathPoint::HOLD)
-                        if (Game::friendlyMapPath[i].pos.x > rightmost->pos.x + (rightmost->character->size.x / 2.0f))
+                        if (Game::friendlyMapPath[i].pos.x > rightmost->pos.x + (getCharacter(rightmost->character).size.x / 2.0f))
                             Game::friendlyMapPath[i].action = Game::MapPathPoint::HOLD;
     }
     else {
-        if (leftmost != soldiers.end())
+        if (leftmost)
             for (int i = 0; i < Game::enemyMapPath.size(); i++)
                 if (Game::enemyMapPath[i].type == Game::MapPathPoint::TRENCH)
                     if (Game::enemyMapPath[i].action != Game::MapPathPoint::HOLD)
-                        if (Game::enemyMapPath[i].pos.x < leftmost->pos.x + (leftmost->character->size.x / 2.0f))
+                        if (Game::enemyMapPath[i].pos.x < leftmost->pos.x + (getCharacter(leftmost->character).size.x / 2.0f))
                             Game::enemyMapPath[i].action = Game::MapPathPoint::HOLD;
     }
 }
 
-// targetEnemies relative to 'soldiers'
-void updateFaction(std::vector<Game::Soldier>& soldiers, const std::vector<Game::Soldier>& targetEnemies, float deltaTime) {
-    int fho = 0, eho = 0;
-
-    for (auto it = soldiers.begin(); it < soldiers.end(); it++) {
-        Game::Soldier& soldier = *it;
+// bullets, sounds and objective count of one chunk of soldiers, merged serially in chunk order
+struct FactionChunk {
+    struct Shot {
+        vector pos, vel;
+        int damage;
+        bool fromEnemy;
+    };
+    std::vector<Shot> shots;
+    struct Sound {
+        Mix_Chunk *chunk;
+        vector pos;
+    };
+    std::vector<Sound> sounds;
+    int holding;
+};
 
-        // death logic
-        if (soldier.health <= 0)
-            Game::soldierDeath(it);
-
-        if (soldier.state == Game::Soldier::DYING) {
-            if (soldier.frameCounter >= soldier.character->death.size()) soldiers.erase(it);
-            continue;
-        }
+// targeting, firing and movement of one soldier, only touches the soldier itself and out
+void updateSoldier(Game::Soldier& soldier, const TargetIndex& targets, FactionChunk& out, float deltaTime) {
+    if (soldier.state == Game::Soldier::DYING) return;
+    const Assets::Character& character = getCharacter(soldier.character);
 
-        // firing logic
-        auto nearestTarget = findNearestTarget(soldier, targetEnemies);
+    // firing logic
+    const TargetIndex::Entry *nearestTarget = targets.nearest(soldier.pos.x, soldier.rand * character.range * TILE_SIZE);
 
-        bool mapcheck = true;
-        if (nearestTarget != targetEnemies.end()) {
-            vector muzzlePoint = {soldier.pos.x + (3.0f * soldier.character->size.x / 4.0f), soldier.pos.y + (soldier.character->size.x / 3.0f)};
-            vector targetPointBody = (nearestTarget->character->size / 2.0f) + nearestTarget->pos;
-            vector targetPointHead = nearestTarget->pos; targetPointHead.y += nearestTarget->character->size.y / 4.0f;
+    bool mapcheck = true;
+    if (nearestTarget) {
+        vector muzzlePoint = {soldier.pos.x + (3.0f * character.size.x / 4.0f), soldier.pos.y + (character.size.x / 3.0f)};
+        vector targetPos = nearestTarget->pos, targetSize = nearestTarget->size;
+        vector targetPointBody = (targetSize / 2.0f) + targetPos;
+        vector targetPointHead = targetPos; targetPointHead.y += targetSize.y / 4.0f;
 
-            bool aimToHead = false;
-            if (intersectsMap(muzzlePoint, targetPointBody)) {
-                aimToHead = true;
-                if (intersectsMap(muzzlePoint, targetPointHead))
-                    goto mapcalc;
-            }
+        bool aimToHead = false;
+        if (losBlocked(muzzlePoint, targetPointBody)) {
+            aimToHead = true;
+            if (losBlocked(muzzlePoint, targetPointHead))
+                goto mapcalc;
+        }
 
-            mapcheck = false;
-            if (soldier.state != Game::Soldier::FIRING) {
-                soldier.prevState = soldier.state;
-                soldier.state = Game::Soldier::IDLE;
-            }
-            if (soldier.cooldownTime <= 0.0f) {
-                soldierFire(it);
-                if (soldier.frameCounter == soldier.character->fireFrame) {
-                    vector vel = ((aimToHead ? targetPointHead : targetPointBody) - muzzlePoint).unit() * soldier.character->muzzleVel;
-                    vector polarVel = vel.toPolar();
-                    polarVel.x += soldier.character->spread * bulletGauss(randgen);
-                    vel = vectorFromPolar(polarVel);
-                    bulletSpawn(muzzlePoint, vel, soldier.character->roundDamage, !soldier.friendly);
-                    soldier.cooldownTime = soldier.character->rpm / 60.0f;
-                    Mix_PlayChannel(-1, soldier.character->fireSnd, 0);
-                }
+        mapcheck = false;
+        if (soldier.state != Game::Soldier::FIRING) {
+            soldier.prevState = soldier.state;
+            soldier.state = Game::Soldier::IDLE;
+        }
+        if (soldier.cooldownTime <= 0.0f) {
+            soldierFire(soldier);
+            if (soldier.frameCounter == character.fireFrame) {
+                vector vel = ((aimToHead ? targetPointHead : targetPointBody) - muzzlePoint).unit() * character.muzzleVel;
+                vector polarVel = vel.toPolar();
+                polarVel.x += character.spread * Random::gauss(Game::matchSeed, soldier.id, Game::tick, Random::AIM);
+                vel = vectorFromPolar(polarVel);
+                out.shots.push_back({ muzzlePoint, vel, character.roundDamage, !soldier.friendly });
+                soldier.cooldownTime = character.rpm / 60.0f;
+                if (!headless) out.sounds.push_back({ character.fireSnd, muzzlePoint });
             }
         }
-        soldier.cooldownTime -= deltaTime;
-
-        // movement logic
-        mapcalc:
-        if (soldier.friendly) {   // friendly
-            for (int i = 1; i < Game::friendlyMapPath.size(); i++) {
-                if (Game::friendlyMapPath[i].pos.x > soldier.pos.x + (soldier.character->size.x / 2.0f)) {
-                    if (mapcheck)
-                        if (Game::friendlyMapPath[i - 1].action == Game::MapPathPoint::MARCH) {
-                            soldier.prevState = soldier.state;
-                            soldier.state = Game::Soldier::MARCHING;
-                        } else {
-                            soldier.prevState = soldier.state;
-                            soldier.state = Game::Soldier::IDLE;
-                        }
-                    if (soldier.state == Game::Soldier::SoldierState::MARCHING) {
-                        vector center = soldier.pos;
-                        center.x += soldier.character->size.x / 2.0f; center.y += soldier.character->size.y;
-                        soldier.pos += (Game::friendlyMapPath[i].pos - center).unit() * (deltaTime * soldier.rand * soldier.character->marchSpeed);
-                    }
-                    break;
+    }
+    soldier.cooldownTime -= deltaTime;
+
+    // movement logic, the path cursor only moves when a waypoint is crossed
+    mapcalc:
+    if (soldier.friendly) {   // friendly
+        float centerX = soldier.pos.x + (character.size.x / 2.0f);
+        int& i = soldier.pathIndex;
+        while (i < Game::friendlyMapPath.size() && Game::friendlyMapPath[i].pos.x <= centerX) i++;
+        while (i > 1 && Game::friendlyMapPath[i - 1].pos.x > centerX) i--;
+
+        if (i < Game::friendlyMapPath.size()) {
+            if (mapcheck)
+                if (Game::friendlyMapPath[i - 1].action == Game::MapPathPoint::MARCH) {
+                    soldier.prevState = soldier.state;
+                    soldier.state = Game::Soldier::MARCHING;
+                } else {
+                    soldier.prevState = soldier.state;
+                    soldier.state = Game::Soldier::IDLE;
                 }
+            if (soldier.state == Game::Soldier::SoldierState::MARCHING) {
+                vector center = soldier.pos;
+                center.x += character.size.x / 2.0f; center.y += character.size.y;
+                soldier.pos += (Game::friendlyMapPath[i].pos - center).unit() * (deltaTime * soldier.rand * character.marchSpeed);
             }
         }
-        else {
-            for (int i = Game::enemyMapPath.size() - 2; i >= 0; i--) {
-                if (Game::enemyMapPath[i].pos.x < soldier.pos.x + (soldier.character->size.x / 2.0f)) {
-                    if (mapcheck)
-                        if (Game::enemyMapPath[i + 1].action == Game::MapPathPoint::MARCH) {
-                            soldier.prevState = soldier.state;
-                            soldier.state = Game::Soldier::MARCHING;
-                        } else {
-                            soldier.prevState = soldier.state;
-                            soldier.state = Game::Soldier::IDLE;
-                        }
-                    if (soldier.state == Game::Soldier::SoldierState::MARCHING) {
-                        vector center = soldier.pos;
-                        center.x += soldier.character->size.x / 2.0f; center.y += soldier.character->size.y;
-                        soldier.pos += (Game::enemyMapPath[i].pos - center).unit() * (deltaTime * soldier.rand * soldier.character->marchSpeed);
-                    }
+    }
+    else {
+        float centerX = soldier.pos.x + (character.size.x / 2.0f);
+        int& i = soldier.pathIndex;
+        while (i >= 0 && Game::enemyMapPath[i].pos.x >= centerX) i--;
+        while (i < int(Game::enemyMapPath.size()) - 2 && Game::enemyMapPath[i + 1].pos.x < centerX) i++;
 
-                    break;
+        if (i >= 0) {
+            if (mapcheck)
+                if (Game::enemyMapPath[i + 1].action == Game::MapPathPoint::MARCH) {
+                    soldier.prevState = soldier.state;
+                    soldier.state = Game::Soldier::MARCHING;
+                } else {
+                    soldier.prevState = soldier.state;
+                    soldier.state = Game::Soldier::IDLE;
                 }
+            if (soldier.state == Game::Soldier::SoldierState::MARCHING) {
+                vector center = soldier.pos;
+                center.x += character.size.x / 2.0f; center.y += character.size.y;
+                soldier.pos += (Game::enemyMapPath[i].pos - center).unit() * (deltaTime * soldier.rand * character.marchSpeed);
             }
         }
+    }
 
-        if (soldier.friendly) {
-            if (abs((soldier.pos.x + (soldier.character->size.x / 2.0f)) - Game::friendlyObjective->pos.x) <= float(TILE_SIZE))
-                fho++;
-        }
-        else {
-            if (abs((soldier.pos.x + (soldier.character->size.x / 2.0f)) - Game::enemyObjective->pos.x) <= float(TILE_SIZE))
-                eho++;
-        }
+    if (soldier.friendly) {
+        if (abs((soldier.pos.x + (character.size.x / 2.0f)) - Game::friendlyObjective->pos.x) <= float(TILE_SIZE))
+            out.holding++;
+    }
+    else {
+        if (abs((soldier.pos.x + (character.size.x / 2.0f)) - Game::enemyObjective->pos.x) <= float(TILE_SIZE))
+            out.holding++;
+    }
+}
+
+// deaths and removals go first and serially, they touch the casualty counters and the pools
+void collectDead(Pool<Game::Soldier>& soldiers) {
+    for (size_t s = 0; s < soldiers.size(); s++) {
+        Game::Soldier& soldier = soldiers[s];
+        if (soldier.health <= 0)
+            Game::soldierDeath(soldier);
+        if (soldier.state == Game::Soldier::DYING && soldier.frameCounter >= getCharacter(soldier.character).death.size())
+            soldiers.remove(s);
     }
+}
+
+constexpr int soldierChunk = 256;
+std::vector<FactionChunk> factionChunks;
+
+void updateFactions(float deltaTime) {
+    PROFILE_SCOPE("updateFactions");
+    collectDead(Game::friendlies);
+    collectDead(Game::enemies);
+
+    friendlyTargets.build(Game::friendlies);
+    enemyTargets.build(Game::enemies);
 
-    if (soldiers.size() > 0)
-        if (soldiers[0].friendly)
-            Game::friendliesHoldingbjective = fho;
-        else
-            Game::enemiesHoldingObjective = eho;
+    int friendlyChunks = (Game::friendlies.size() + soldierChunk - 1) / soldierChunk;
+    int chunks = friendlyChunks + (Game::enemies.size() + soldierChunk - 1) / soldierChunk;
+    if (factionChunks.size() < chunks) factionChunks.resize(chunks);
 
-    resetTrenches(soldiers);
+    // random draws are keyed by soldier and tick and the merge below runs in chunk
+    // order, so the result doesn't depend on the thread count
+    Jobs::parallelFor(chunks, [&](int chunk) {
+        PROFILE_SCOPE("updateFaction");
+        bool enemy = chunk >= friendlyChunks;
+        Pool<Game::Soldier>& soldiers = enemy ? Game::enemies : Game::friendlies;
+        const TargetIndex& targets = enemy ? friendlyTargets : enemyTargets;
+
+        FactionChunk& out = factionChunks[chunk];
+        out.shots.clear();
+        out.sounds.clear();
+        out.holding = 0;
+
+        size_t first = size_t(enemy ? chunk - friendlyChunks : chunk) * soldierChunk;
+        size_t last = std::min(soldiers.size(), first + soldierChunk);
+        for (size_t s = first; s < last; s++)
+            if (!soldiers.isRemoved(s)) updateSoldier(soldiers[s], targets, out, deltaTime);
+    });
+
+    int fho = 0, eho = 0;
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        FactionChunk& out = factionChunks[chunk];
+        for (const FactionChunk::Shot& shot : out.shots)
+            bulletSpawn(shot.pos, shot.vel, shot.damage, shot.fromEnemy);
+        for (const FactionChunk::Sound& sound : out.sounds)
+            Audio::fire(sound.chunk, sound.pos);
+        (chunk < friendlyChunks ? fho : eho) += out.holding;
+    }
+
+    Game::friendliesHoldingbjective = fho;
+    Game::enemiesHoldingObjective = eho;
+
+    resetTrenches(Game::friendlies);
+    resetTrenches(Game::enemies);
 }
 
 void Game::update(float deltaTime) {
-    updateBullets(deltaTime);
+    PROFILE_SCOPE("Game::update");
+    // keep last tick positions for render interpolation, bullets do it when integrating
+    for (Game::Soldier& soldier : Game::friendlies) soldier.prevPos = soldier.pos;
+    for (Game::Soldier& soldier : Game::enemies) soldier.prevPos = soldier.pos;
+
+    // animations run on simulation time, rendering only reads frameCounter
+    Game::updateAnimations(deltaTime);
+    Game::tick++;
+
+    Game::updateBullets(deltaTime);
+
+    updateFactions(deltaTime);
+
+    // drop everything removed this tick
+    Game::friendlies.compact();
+    Game::enemies.compact();
+    Game::bullets.compact();
+
+    if (headless) return;
 
-    updateFaction(Game::friendlies, Game::enemies, deltaTime);
-    updateFaction(Game::enemies, Game::friendlies, deltaTime);
-    
     if (Mix_PlayingMusic() == 0) {
-        if (musicPlayingTrack >= Game::friendlyFaction->gameplayMusic.size()) musicPlayingTrack = 0;
-        if (Mix_PlayMusic(Game::friendlyFaction->gameplayMusic[musicPlayingTrack].track, 0) < 0) {
+        if (musicPlayingTrack >= getFaction(Game::friendlyFaction).gameplayMusic.size()) musicPlayingTrack = 0;
+        if (Mix_PlayMusic(getFaction(Game::friendlyFaction).gameplayMusic[musicPlayingTrack].track, 0) < 0) {
             error_sdl("Error playing music");
         }
         musicPlayingTrack++;
     }
 }
+
+// frame of a clip at time, frames.size() once the clip is over
+int clipFrame(const std::vector<float>& times, float time) {
+    return std::upper_bound(times.begin(), times.end(), time) - times.begin();
+}
+
+float clipLength(const std::vector<float>& times) {
+    return times.empty() ? 0.0f : times.back();
+}
+
+void animateSoldiers(Pool<Game::Soldier>& soldiers, float deltaTime) {
+    for (Game::Soldier& soldier : soldiers) {
+        const Assets::Character& character = getCharacter(soldier.character);
+        soldier.animTime += deltaTime;
+        switch (soldier.state) {
+            case Game::Soldier::FIRING: {
+                if (soldier.animTime >= clipLength(character.fireTimes)) { soldier.state = soldier.prevState; soldier.animTime = 0.0f; soldier.frameCounter = 0; }
+                else soldier.frameCounter = clipFrame(character.fireTimes, soldier.animTime);
+            } break;
+            case Game::Soldier::DYING: {
+                soldier.frameCounter = clipFrame(character.deathTimes, soldier.animTime);
+            } break;
+            case Game::Soldier::MARCHING: {
+                float length = clipLength(character.marchTimes);
+                if (length > 0.0f) soldier.animTime = std::fmod(soldier.animTime, length);
+                soldier.frameCounter = clipFrame(character.marchTimes, soldier.animTime);
+            } break;
+            default: {
+                soldier.animTime = 0.0f;
+                soldier.frameCounter = 0;
+            } break;
+        }
+    }
+}
+
+void Game::updateAnimations(float deltaTime) {
+    animateSoldiers(Game::friendlies, deltaTime);
+    animateSoldiers(Game::enemies, deltaTime);
+}
@@ -0,0 +1,319 @@
+/*
+    ww1game:      Generic WW1 game (?)
+    headless.cpp: Simulation without window, textures or audio
+
+    Copyright (C) 2022 Ángel Ruiz Fernandez
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "main.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <iomanip>
+
+#include <SDL2/SDL_image.h>
+
+// spawn up to count soldiers on one side, cycling through the faction characters
+void spawnWave(Assets::FactionId faction, bool enemy, int count, int& spawned, int total) {
+    int characters = getFaction(faction).characters.size();
+    if (characters == 0) return;
+    for (int i = 0; i < count && spawned < total; i++, spawned++)
+        Game::soldierSpawn({ faction, int16_t(spawned % characters) }, enemy);
+}
+
+// time one call of f per tick over ticks ticks, returns the mean in seconds
+template<typename F>
+double timeTicks(int ticks, F f) {
+    auto time_start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; tick++) f(tick);
+    auto time_end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(time_end - time_start).count() / ticks;
+}
+
+// place n soldiers per side standing on the path, friendlies on the left
+// third of the map and enemies on the right third, like two held trench lines
+void spreadSoldiers(int n, std::mt19937& gen) {
+    Game::friendlies.clear();
+    Game::enemies.clear();
+    float mapEnd = Game::friendlyMapPath[Game::friendlyMapPath.size() - 1].pos.x;
+    std::uniform_real_distribution<float> friendlyDist(0.0f, mapEnd / 3.0f);
+    std::uniform_real_distribution<float> enemyDist(2.0f * mapEnd / 3.0f, mapEnd - 4 * TILE_SIZE);
+
+    for (int i = 0; i < 2 * n; i++) {
+        bool enemy = i % 2;
+        Assets::FactionId faction = enemy ? Game::enemyFaction : Game::friendlyFaction;
+        Handle handle = Game::soldierSpawn({ faction, int16_t((i / 2) % getFaction(faction).characters.size()) }, enemy);
+        Game::Soldier& soldier = *(enemy ? Game::enemies : Game::friendlies).get(handle);
+
+        soldier.pos.x = enemy ? enemyDist(gen) : friendlyDist(gen);
+        for (int p = 1; p < Game::friendlyMapPath.size(); p++)
+            if (Game::friendlyMapPath[p].pos.x > soldier.pos.x + getCharacter(soldier.character).size.x / 2.0f) {
+                soldier.pos.y = Game::friendlyMapPath[p].pos.y - getCharacter(soldier.character).size.y;
+                break;
+            }
+        soldier.prevPos = soldier.pos;
+        soldier.health = 1 << 30;   // nobody dies, the population stays fixed
+    }
+}
+
+// bullet vs soldier collision cost as the armies grow
+void benchCollision(const Headless::Options& options) {
+    std::mt19937 gen(options.seed);
+    float deltaTime = 1.0f / Game::tickRate;
+    int ticks = std::max(1, std::min(options.ticks, 200));
+
+    std::cout << "soldiers/side  bullets  us/tick  ns/bullet" << std::endl;
+    for (int n : { 100, 300, 1000, 3000, 10000 }) {
+        spreadSoldiers(n, gen);
+
+        // one round in flight per soldier, fired towards the other side
+        std::uniform_int_distribution<int> shooterDist(0, n - 1);
+        std::normal_distribution<float> angleDist(0.0f, 0.05f);
+        auto refill = [&]() {
+            while (Game::bullets.size() < 2 * n) {
+                bool fromEnemy = Game::bullets.size() % 2;
+                const Game::Soldier& shooter = fromEnemy ? Game::enemies[shooterDist(gen)] : Game::friendlies[shooterDist(gen)];
+                vector pos = { shooter.pos.x + (fromEnemy ? 0.0f : getCharacter(shooter.character).size.x), shooter.pos.y + getCharacter(shooter.character).size.y / 3.0f };
+                vector vel = vectorFromPolar({ (fromEnemy ? float(M_PI) : 0.0f) + angleDist(gen), getCharacter(shooter.character).muzzleVel });
+                Game::bullets.add(pos, vel, getCharacter(shooter.character).roundDamage, fromEnemy);
+            }
+        };
+
+        Game::bullets.clear();
+        refill();
+        double perTick = timeTicks(ticks, [&](int) {
+            Game::updateBullets(deltaTime);
+            Game::bullets.compact();
+            refill();
+        });
+
+        std::cout << std::setw(13) << n << std::setw(9) << 2 * n << std::setw(9) << std::fixed << std::setprecision(1) << perTick * 1e6
+            << std::setw(11) << perTick * 1e9 / (2 * n) << std::defaultfloat << std::endl;
+    }
+
+    Game::friendlies.clear();
+    Game::enemies.clear();
+    Game::bullets.clear();
+}
+
+// the bullet layout before Game::Bullets, one struct per round
+struct AosBullet {
+    vector pos;
+    vector prevPos;
+    vector vel;
+    int damage;
+    bool fromEnemy;
+};
+
+// best of a few runs of ticks, each from a fresh copy of the rounds, the
+// machine is rarely quiet enough for a single run
+template<typename T, typename F>
+double bestTime(const T& initial, T& state, int ticks, F f) {
+    double best = 0.0;
+    for (int run = 0; run < 5; run++) {
+        state = initial;
+        double time = timeTicks(ticks, [&](int) { f(state); });
+        if (run == 0 || time < best) best = time;
+    }
+    return best;
+}
+
+// bullet integration and out of map culling: the std::vector and erase loop
+// the game had before pools, the Pool of structs with deferred removal, and
+// the parallel arrays with the scalar and the SIMD kernel
+void benchBullets(const Headless::Options& options) {
+    std::mt19937 gen(options.seed);
+    float deltaTime = 1.0f / Game::tickRate;
+    float mapEnd = Game::friendlyMapPath[Game::friendlyMapPath.size() - 1].pos.x;
+    int ticks = std::max(1, std::min(options.ticks, 100));     // most rounds still in the air at the end
+    int muzzleVel = getFaction(Game::friendlyFaction).characters[0].muzzleVel;
+
+    std::cout << "bullets  erase us/tick    pool  soa scalar  soa simd  culled  match" << std::endl;
+    for (int n : { 1000, 4000, 16000, 64000 }) {
+        std::uniform_real_distribution<float> xDist(0.0f, mapEnd), yDist(0.0f, getSelectedMap().height * TILE_SIZE);
+        std::normal_distribution<float> angleDist(0.0f, 0.05f);
+
+        std::vector<AosBullet> initialVector;
+        Pool<AosBullet> initialPool;
+        Game::Bullets initial;
+        for (int i = 0; i < n; i++) {
+            bool fromEnemy = i % 2;
+            vector pos = { xDist(gen), yDist(gen) };
+            vector vel = vectorFromPolar({ (fromEnemy ? float(M_PI) : 0.0f) + angleDist(gen), float(muzzleVel) });
+            initialVector.push_back({ pos, pos, vel, 1, fromEnemy });
+            initialPool.add({ pos, pos, vel, 1, fromEnemy });
+            initial.add(pos, vel, 1, fromEnemy);
+        }
+
+        // every variant starts from the same rounds and culls each tick like the game
+        std::vector<AosBullet> erased;
+        double eraseTime = bestTime(initialVector, erased, ticks, [&](std::vector<AosBullet>& bullets) {
+            for (auto it = bullets.begin(); it != bullets.end();) {
+                it->prevPos = it->pos;
+                it->pos += it->vel * deltaTime;
+                if (it->pos.x < 0.0f || it->pos.x > mapEnd) it = bullets.erase(it);
+                else it++;
+            }
+        });
+
+        Pool<AosBullet> pool;
+        double poolTime = bestTime(initialPool, pool, ticks, [&](Pool<AosBullet>& bullets) {
+            for (size_t i = 0; i < bullets.size(); i++) {
+                AosBullet& bullet = bullets[i];
+                bullet.prevPos = bullet.pos;
+                bullet.pos += bullet.vel * deltaTime;
+                if (bullet.pos.x < 0.0f || bullet.pos.x > mapEnd) bullets.remove(i);
+            }
+            bullets.compact();
+        });
+
+        Game::Bullets scalar;
+        double scalarTime = bestTime(initial, scalar, ticks, [&](Game::Bullets& bullets) {
+            bullets.integrateScalar(deltaTime, 0.0f, mapEnd);
+            bullets.compact();
+        });
+
+        Game::Bullets simd;
+        double simdTime = bestTime(initial, simd, ticks, [&](Game::Bullets& bullets) {
+            bullets.integrate(deltaTime, 0.0f, mapEnd);
+            bullets.compact();
+        });
+
+        // all four must agree bit for bit, erase keeps the order the others swap
+        bool match = erased.size() == simd.size() && pool.size() == simd.size() && scalar.size() == simd.size();
+        for (size_t i = 0; match && i < simd.size(); i++)
+            match = pool[i].pos.x == simd.x[i] && pool[i].pos.y == simd.y[i]
+                && scalar.x[i] == simd.x[i] && scalar.y[i] == simd.y[i];
+        if (match) {
+            std::vector<std::pair<float, float>> a, b;
+            for (const AosBullet& bullet : erased) a.push_back({ bullet.pos.x, bullet.pos.y });
+            for (size_t i = 0; i < simd.size(); i++) b.push_back({ simd.x[i], simd.y[i] });
+            std::sort(a.begin(), a.end());
+            std::sort(b.begin(), b.end());
+            match = a == b;
+        }
+        int culled = n - simd.size();
+
+        std::cout << std::setw(7) << n << std::fixed << std::setprecision(2) << std::setw(16) << eraseTime * 1e6
+            << std::setw(8) << poolTime * 1e6 << std::setw(12) << scalarTime * 1e6 << std::setw(10) << simdTime * 1e6
+            << std::defaultfloat << std::setw(8) << culled << std::setw(7) << (match ? "yes" : "NO") << std::endl;
+    }
+}
+
+// the pools still hold the dying until their animation ends
+int countAlive(const Pool<Game::Soldier>& soldiers) {
+    int alive = 0;
+    for (const Game::Soldier& soldier : soldiers)
+        if (soldier.state != Game::Soldier::DYING) alive++;
+    return alive;
+}
+
+void Headless::initSDL() {
+    // images are only decoded to know character sizes, no video needed
+    int imgFlags = IMG_INIT_PNG;
+    if (!(IMG_Init(imgFlags) & imgFlags))
+        exit_error_img("IMG_Init failed");
+}
+
+void Headless::destroySDL() {
+    IMG_Quit();
+}
+
+int Headless::run(const Headless::Options& options) {
+    // select map
+    Game::selectedCampaign = 0;
+    if (options.campaign.size() > 0) {
+        Game::selectedCampaign = Assets::findCampaign(options.campaign);
+        if (Game::selectedCampaign < 0)
+            exit_error("Error: Campaign not found: " + options.campaign);
+    }
+
+    const Assets::Campaign& campaign = Assets::campaigns[Game::selectedCampaign];
+    if (options.map < 0 || options.map >= campaign.maps.size())
+        exit_error("Error: Map " + std::to_string(options.map) + " not found in campaign " + campaign.name);
+    Game::selectedMap = options.map;
+
+    Game::seed(options.seed);
+    Game::mapSetup();
+
+    if (Game::friendlyFaction < 0)
+        exit_error("Error: Friendly faction not found: " + getSelectedMap().friendlyFactionName);
+    if (Game::enemyFaction < 0)
+        exit_error("Error: Enemy faction not found: " + getSelectedMap().enemyFactionName);
+
+    if (options.bench == "collision") {
+        benchCollision(options);
+        Game::mapTeardown();
+        return 0;
+    } else if (options.bench == "bullets") {
+        benchBullets(options);
+        Game::mapTeardown();
+        return 0;
+    } else if (options.bench.size() > 0) {
+        exit_error("Error: Unknown benchmark: " + options.bench);
+    }
+
+    std::cout << "Running " << options.ticks << " ticks at " << Game::tickRate << " Hz on "
+        << campaign.nameNice << " / " << getSelectedMap().name << ", seed " << options.seed
+        << ", " << Jobs::threadCount() << " threads" << std::endl;
+
+    float deltaTime = 1.0f / Game::tickRate;
+    int spawnInterval = std::max(1, options.spawnInterval);
+    int friendliesSpawned = 0, enemiesSpawned = 0;
+
+    std::vector<double> tickTimes;
+    tickTimes.reserve(options.ticks);
+
+    for (int tick = 0; tick < options.ticks; tick++) {
+        if (tick % spawnInterval == 0) {
+            spawnWave(Game::friendlyFaction, false, options.spawnWave, friendliesSpawned, options.soldiers);
+            spawnWave(Game::enemyFaction, true, options.spawnWave, enemiesSpawned, options.soldiers);
+        }
+
+        if (options.advanceInterval > 0 && tick > 0 && tick % options.advanceInterval == 0) {
+            Game::advance(false);
+            Game::advance(true);
+        }
+
+        auto time_start = std::chrono::steady_clock::now();
+        Game::update(deltaTime);
+        auto time_end = std::chrono::steady_clock::now();
+
+        tickTimes.push_back(std::chrono::duration<double>(time_end - time_start).count());
+    }
+
+    // report
+    double total = 0.0;
+    for (double t : tickTimes) total += t;
+    std::sort(tickTimes.begin(), tickTimes.end());
+
+    auto percentile = [&](double p) {
+        if (tickTimes.size() == 0) return 0.0;
+        return tickTimes[std::min(tickTimes.size() - 1, (size_t)(p * tickTimes.size()))];
+    };
+
+    std::cout << "Simulated " << options.ticks / Game::tickRate << " s in " << total << " s" << std::endl;
+    std::cout << "ticks/sec: " << (total > 0.0 ? options.ticks / total : 0.0) << std::endl;
+    std::cout << "tick p50: " << percentile(0.50) * 1e6 << " us, p99: " << percentile(0.99) * 1e6 << " us" << std::endl;
+    std::cout << "friendlies: spawned " << friendliesSpawned << ", alive " << countAlive(Game::friendlies) << ", casualties " << Game::friendlyCasualties << std::endl;
+    std::cout << "enemies: spawned " << enemiesSpawned << ", alive " << countAlive(Game::enemies) << ", casualties " << Game::enemyCasualties << std::endl;
+    std::cout << "bullets in flight: " << Game::bullets.size() << std::endl;
+
+    Game::mapTeardown();
+    return 0;
+}
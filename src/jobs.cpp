@@ -0,0 +1,104 @@
+/*
+    ww1game:      Generic WW1 game (?)
+    jobs.cpp:     Worker thread pool for the simulation
+
+    Copyright (C) 2022 Ángel Ruiz Fernandez
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "main.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+std::vector<std::thread> workers;
+std::mutex jobMutex;
+std::condition_variable jobWake, jobDone;
+
+const std::function<void(int)> *job = nullptr;
+int jobChunks = 0;
+std::atomic<int> jobNextChunk(0);
+int jobBusyWorkers = 0;
+long jobBatch = 0;
+bool jobQuit = false;
+
+// take chunks until there are none left
+void workChunks() {
+    for (int chunk = jobNextChunk++; chunk < jobChunks; chunk = jobNextChunk++)
+        (*job)(chunk);
+}
+
+void workerLoop(int index) {
+    Profiler::setThreadName("worker " + std::to_string(index));
+    long seenBatch = 0;
+    std::unique_lock<std::mutex> lock(jobMutex);
+    while (true) {
+        jobWake.wait(lock, [&]() { return jobQuit || jobBatch != seenBatch; });
+        if (jobQuit) return;
+        seenBatch = jobBatch;
+
+        lock.unlock();
+        workChunks();
+        lock.lock();
+
+        if (--jobBusyWorkers == 0) jobDone.notify_one();
+    }
+}
+
+void Jobs::init(int threads) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(workerLoop, i);
+}
+
+void Jobs::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobQuit = true;
+    }
+    jobWake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+    workers.clear();
+    jobQuit = false;
+}
+
+int Jobs::threadCount() {
+    return workers.size() + 1;
+}
+
+void Jobs::parallelFor(int chunks, const std::function<void(int)>& f) {
+    if (workers.size() == 0 || chunks <= 1) {
+        for (int chunk = 0; chunk < chunks; chunk++) f(chunk);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        job = &f;
+        jobChunks = chunks;
+        jobNextChunk = 0;
+        jobBusyWorkers = workers.size();
+        jobBatch++;
+    }
+    jobWake.notify_all();
+
+    workChunks();
+
+    std::unique_lock<std::mutex> lock(jobMutex);
+    jobDone.wait(lock, []() { return jobBusyWorkers == 0; });
+    job = nullptr;
+}
@@ -23,10 +23,14 @@
 #include <vector>
 #include <filesystem>
 #include <fstream>
+#include <sstream>
+#include <cstring>
 #include <algorithm>
+#include <unordered_map>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <SDL2/SDL_mixer.h>
 
 namespace Assets {
     std::vector<TerrainVariant> terrainVariants;
@@ -34,8 +38,33 @@ namespace Assets {
     std::vector<Faction> factions;
     std::vector<Font> fonts;
     std::vector<Background> backgrounds;
-    SDL_Texture *bulletTexture;
-    SDL_Texture *flagpoleTexture;
+    std::vector<AtlasPage> atlasPages;
+    Sprite bulletSprite;
+    Sprite flagpoleSprite;
+    Sprite missingSprite;
+}
+
+// name -> handle, filled while indexing
+std::unordered_map<std::string, Assets::TerrainVariantId> terrainVariantIds;
+std::unordered_map<std::string, Assets::CampaignId> campaignIds;
+std::unordered_map<std::string, Assets::FactionId> factionIds;
+std::unordered_map<std::string, Assets::BackgroundId> backgroundIds;
+
+template<typename Id>
+Id findId(const std::unordered_map<std::string, Id>& ids, const std::string& name) {
+    auto it = ids.find(name);
+    return it == ids.end() ? Id(-1) : it->second;
+}
+
+Assets::TerrainVariantId Assets::findTerrainVariant(const std::string& name) { return findId(terrainVariantIds, name); }
+Assets::CampaignId Assets::findCampaign(const std::string& name) { return findId(campaignIds, name); }
+Assets::FactionId Assets::findFaction(const std::string& name) { return findId(factionIds, name); }
+Assets::BackgroundId Assets::findBackground(const std::string& name) { return findId(backgroundIds, name); }
+
+Assets::CharacterId Assets::findCharacter(Assets::FactionId faction, const std::string& name) {
+    if (faction < 0) return { };
+    int16_t character = findId(getFaction(faction).characterIds, name);
+    return character < 0 ? Assets::CharacterId() : Assets::CharacterId { faction, character };
 }
 
 std::string makeNameNice(std::string str) {
@@ -46,76 +75,482 @@ std::string makeNameNice(std::string str) {
     return str;
 }
 
-void loadTerrains(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath + "/textures"))
+// every path in ASSET_SEARCH_PATHS is mounted into one tree of names relative
+// to the asset root ("textures/bullet.png"), a file in a later path shadows the
+// same name in an earlier one. A path is read from its directory tree or, when
+// it has one, from the bundle packed by ww1game-pack. Bundles stay mapped for
+// the whole run, music and fonts read from them while playing.
+struct AssetSource {
+    std::filesystem::path root;
+    Bundle::Reader *bundle;
+};
+std::vector<AssetSource> assetSources;
+std::unordered_map<std::string, int> assetFiles;                            // name -> source it is read from
+std::unordered_map<std::string, std::vector<std::string>> assetDirs;        // directory -> child names, sorted
+
+std::string assetName(const std::filesystem::path& name) {
+    return name.lexically_normal().generic_string();
+}
+
+void mountFile(const std::string& name, int source) {
+    bool shadowed = assetFiles.count(name);
+    assetFiles[name] = source;
+    if (shadowed) return;
+
+    // every parent directory lists its child once
+    std::string child = name;
+    for (size_t slash = child.rfind('/'); ; slash = child.rfind('/')) {
+        std::string parent = slash == std::string::npos ? "" : child.substr(0, slash);
+        bool seen = assetDirs.count(parent);
+        assetDirs[parent].push_back(child.substr(slash == std::string::npos ? 0 : slash + 1));
+        if (seen || slash == std::string::npos) break;
+        child = parent;
+    }
+}
+
+// add a search path on top of the ones mounted so far
+void mountSource(const std::filesystem::path& root) {
+    PROFILE_SCOPE("mountSource");
+    Bundle::Reader *bundle = NULL;
+    if (std::filesystem::exists(root / BUNDLE_FILENAME)) {
+        bundle = new Bundle::Reader;
+        if (Bundle::open((root / BUNDLE_FILENAME).string(), *bundle)) {
+            std::cout << "Using bundle " << (root / BUNDLE_FILENAME).string() << ", " << bundle->entries.size() << " files" << std::endl;
+        } else {
+            delete bundle;
+            bundle = NULL;
+        }
+    }
+
+    int source = assetSources.size();
+    assetSources.push_back({ root, bundle });
+    if (bundle) {
+        for (const auto& [name, entry] : bundle->entries)
+            mountFile(name, source);
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied)) {
+        if (!entry.is_regular_file()) continue;
+        mountFile(entry.path().lexically_relative(root).generic_string(), source);
+    }
+}
+
+bool assetExists(const std::filesystem::path& name) {
+    return assetFiles.count(assetName(name)) || assetDirs.count(assetName(name));
+}
+
+bool assetIsDir(const std::filesystem::path& name) {
+    return assetDirs.count(assetName(name));
+}
+
+// children of a directory as names relative to the root, sorted
+std::vector<std::filesystem::path> assetList(const std::filesystem::path& dir) {
+    std::vector<std::filesystem::path> children;
+    auto it = assetDirs.find(assetName(dir));
+    if (it != assetDirs.end())
+        for (const std::string& child : it->second) children.push_back(dir / child);
+    return children;
+}
+
+// every file under a directory
+void assetWalk(const std::filesystem::path& dir, std::vector<std::filesystem::path>& files) {
+    for (const std::filesystem::path& child : assetList(dir)) {
+        if (assetIsDir(child)) assetWalk(child, files);
+        else files.push_back(child);
+    }
+}
+
+SDL_RWops* assetOpen(const std::filesystem::path& name) {
+    auto it = assetFiles.find(assetName(name));
+    if (it == assetFiles.end()) return NULL;
+    const AssetSource& source = assetSources[it->second];
+    if (source.bundle) {
+        const Bundle::Entry *entry = source.bundle->find(it->first);
+        if (entry == NULL || entry->type != Bundle::Entry::FILE) return NULL;
+        return SDL_RWFromConstMem(source.bundle->contents(entry), entry->size);
+    }
+    return SDL_RWFromFile((source.root / name).string().c_str(), "rb");
+}
+
+// the whole contents of a file and their hash, pointing into the bundle or
+// read into storage. Only reads the index, so it can run on the workers.
+struct AssetBlob {
+    const uint8_t *data = NULL;
+    size_t size = 0;
+    std::vector<uint8_t> storage;
+    const Bundle::Entry *entry = NULL;     // read from a bundle, PROPERTIES and MAP are parsed already
+    const Bundle::Entry *image = NULL;     // decoded RGBA32 pixels from a bundle
+    uint64_t hash = 0;
+};
+
+bool assetRead(const std::filesystem::path& name, AssetBlob& blob) {
+    auto it = assetFiles.find(assetName(name));
+    if (it == assetFiles.end()) return false;
+    const AssetSource& source = assetSources[it->second];
+    if (source.bundle) {
+        const Bundle::Entry *entry = source.bundle->find(it->first);
+        if (entry == NULL) return false;
+        blob.entry = entry;
+        blob.data = source.bundle->contents(entry);
+        blob.size = entry->size;
+        blob.image = entry->type == Bundle::Entry::IMAGE ? entry : NULL;
+        // the same pixels in another shape are another image
+        blob.hash = blob.image ? entry->hash ^ (uint64_t(entry->width) << 32 | entry->height) : entry->hash;
+        return true;
+    }
+
+    std::ifstream in(source.root / name, std::ios::binary);
+    if (!in.is_open()) return false;
+    blob.storage.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    blob.data = blob.storage.data();
+    blob.size = blob.storage.size();
+    blob.hash = hashBytes(blob.data, blob.size);
+    return true;
+}
+
+// images packed in a bundle are already RGBA32, the surface points into the mapping
+SDL_Surface* decodeImage(const AssetBlob& blob) {
+    if (blob.image)
+        return SDL_CreateRGBSurfaceWithFormatFrom((void*)blob.data, blob.image->width, blob.image->height, 32, blob.image->width * 4, SDL_PIXELFORMAT_RGBA32);
+    return IMG_Load_RW(SDL_RWFromConstMem(blob.data, blob.size), 1);
+}
+
+SDL_Surface* assetImage(const std::filesystem::path& name) {
+    AssetBlob blob;
+    return assetRead(name, blob) ? decodeImage(blob) : NULL;
+}
+
+void blobLines(const AssetBlob& blob, std::vector<std::string>& lines) {
+    std::istringstream stream(std::string((const char*)blob.data, blob.size));
+    std::string line;
+    while (std::getline(stream, line))
+        lines.push_back(line);
+}
+
+// sprites are packed in shelves into big atlas pages, kept as surfaces while
+// loading and uploaded as textures at the end, so draws of terrain, soldiers
+// and bullets mostly share a texture. Each uploaded group (the always loaded
+// sprites, a terrain variant, a faction) gets its own pages so it can be freed.
+// Images with the same contents share one sprite, a group that reuses a sprite
+// from a page of another group keeps that page alive too.
+constexpr int atlasPadding = 1;
+int atlasPageSize = 2048;
+std::vector<SDL_Surface*> atlasSurfaces;    // pages not uploaded yet
+std::vector<int> atlasSlots;                // their index in Assets::atlasPages
+std::vector<int> atlasHeights;              // rows used in each of them
+std::vector<int> atlasBorrowed;             // uploaded pages the group uses sprites of
+std::unordered_map<uint64_t, Assets::Sprite> atlasCache;   // by content hash
+int atlasX = 0, atlasY = 0, atlasShelfHeight = 0;
+
+int atlasFreeSlot() {
+    for (int i = 0; i < Assets::atlasPages.size(); i++)
+        if (Assets::atlasPages[i].texture == NULL && std::find(atlasSlots.begin(), atlasSlots.end(), i) == atlasSlots.end())
+            return i;
+    Assets::atlasPages.push_back({ });
+    return Assets::atlasPages.size() - 1;
+}
+
+Assets::Sprite atlasAdd(SDL_Surface *surf, uint64_t hash) {
+    if (surf->w > atlasPageSize || surf->h > atlasPageSize) {
+        warning("Image of " + std::to_string(surf->w) + "x" + std::to_string(surf->h) + " does not fit in an atlas page");
+        return Assets::missingSprite;
+    }
+
+    // next shelf, or next page
+    if (atlasSurfaces.size() > 0 && atlasX + surf->w > atlasPageSize) {
+        atlasX = 0;
+        atlasY += atlasShelfHeight + atlasPadding;
+        atlasShelfHeight = 0;
+    }
+    if (atlasSurfaces.size() == 0 || atlasY + surf->h > atlasPageSize) {
+        SDL_Surface *page = SDL_CreateRGBSurfaceWithFormat(0, atlasPageSize, atlasPageSize, 32, SDL_PIXELFORMAT_RGBA32);
+        if (page == NULL) exit_error_sdl("SDL_CreateRGBSurfaceWithFormat failed on atlas page");
+        atlasSlots.push_back(atlasFreeSlot());
+        atlasSurfaces.push_back(page);
+        atlasHeights.push_back(0);
+        atlasX = 0; atlasY = 0; atlasShelfHeight = 0;
+    }
+
+    Assets::Sprite sprite;
+    sprite.page = atlasSlots.back();
+    sprite.rect = { atlasX, atlasY, surf->w, surf->h };
+
+    SDL_Rect dst = sprite.rect;
+    SDL_SetSurfaceBlendMode(surf, SDL_BLENDMODE_NONE);     // copy alpha as it is
+    if (SDL_BlitSurface(surf, NULL, atlasSurfaces.back(), &dst) < 0)
+        error_sdl("SDL_BlitSurface failed on atlas page");
+
+    atlasX += surf->w + atlasPadding;
+    atlasShelfHeight = std::max(atlasShelfHeight, surf->h);
+    atlasHeights.back() = std::max(atlasHeights.back(), atlasY + surf->h);
+    atlasCache[hash] = sprite;
+    return sprite;
+}
+
+// a sprite packed before, its page is used by the group being loaded
+void atlasBorrow(const Assets::Sprite& sprite) {
+    if (std::find(atlasSlots.begin(), atlasSlots.end(), sprite.page) != atlasSlots.end()) return;
+    if (std::find(atlasBorrowed.begin(), atlasBorrowed.end(), sprite.page) != atlasBorrowed.end()) return;
+    atlasBorrowed.push_back(sprite.page);
+}
+
+// upload the pages packed so far, only as tall as they are filled, and
+// return every page the group uses
+std::vector<int> atlasUpload() {
+    PROFILE_SCOPE("atlasUpload");
+    for (size_t i = 0; i < atlasSurfaces.size(); i++) {
+        SDL_Surface *page = atlasSurfaces[i];
+        SDL_Texture *texture;
+        if ((texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, atlasPageSize, atlasHeights[i])) == NULL)
+            exit_error_sdl("SDL_CreateTexture failed on atlas page");
+        if (SDL_UpdateTexture(texture, NULL, page->pixels, page->pitch) < 0)
+            error_sdl("SDL_UpdateTexture failed on atlas page");
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        Assets::atlasPages[atlasSlots[i]] = { texture, atlasPageSize, atlasHeights[i] };
+        SDL_FreeSurface(page);
+    }
+
+    std::vector<int> pages = atlasSlots;
+    pages.insert(pages.end(), atlasBorrowed.begin(), atlasBorrowed.end());
+    for (int page : pages)
+        Assets::atlasPages[page].users++;
+    atlasSurfaces.clear();
+    atlasSlots.clear();
+    atlasHeights.clear();
+    atlasBorrowed.clear();
+    return pages;
+}
+
+void atlasRelease(std::vector<int>& pages) {
+    for (int page : pages) {
+        if (--Assets::atlasPages[page].users > 0) continue;
+        SDL_DestroyTexture(Assets::atlasPages[page].texture);
+        Assets::atlasPages[page] = { };
+        for (auto it = atlasCache.begin(); it != atlasCache.end(); )
+            it = it->second.page == page ? atlasCache.erase(it) : std::next(it);
+    }
+    pages.clear();
+}
+
+// images and sound effects are read and decoded up front on the worker pool,
+// the loaders below take the decoded surface or chunk out of here and only the
+// texture upload stays on the main thread. Images are decoded once per
+// content, and not at all when the atlas already has them.
+std::unordered_map<std::string, uint64_t> decodedHashes;           // image name -> content hash
+std::unordered_map<uint64_t, SDL_Surface*> decodedSurfaces;        // by content hash
+std::unordered_map<std::string, Mix_Chunk*> decodedChunks;
+
+void decodeAssets(const std::vector<std::filesystem::path>& dirs) {
+    PROFILE_SCOPE("decodeAssets");
+    std::vector<std::filesystem::path> files, images, sounds;
+    for (const std::filesystem::path& dir : dirs)
+        assetWalk(dir, files);
+    for (const std::filesystem::path& file : files) {
+        if (file.extension() == ".png") images.push_back(file);
+        else if (file.extension() == ".ogg") sounds.push_back(file);
+    }
+
+    std::vector<AssetBlob> blobs(images.size());
+    std::vector<uint8_t> read(images.size(), false);  // not vector<bool>, workers write neighbours
+    std::vector<Mix_Chunk*> chunks(sounds.size(), NULL);
+    Jobs::parallelFor(images.size() + sounds.size(), [&](int i) {
+        if (i < images.size()) read[i] = assetRead(images[i], blobs[i]);
+        else if (SDL_RWops *rw = assetOpen(sounds[i - images.size()]))
+            chunks[i - images.size()] = Mix_LoadWAV_RW(rw, 1);
+    });
+
+    // first of each content not packed or decoded yet
+    std::vector<int> unique;
+    std::unordered_map<uint64_t, bool> queued;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!read[i]) continue;
+        decodedHashes[assetName(images[i])] = blobs[i].hash;
+        if (atlasCache.count(blobs[i].hash) || decodedSurfaces.count(blobs[i].hash) || queued[blobs[i].hash]) continue;
+        queued[blobs[i].hash] = true;
+        unique.push_back(i);
+    }
+
+    std::vector<SDL_Surface*> surfaces(unique.size(), NULL);
+    Jobs::parallelFor(unique.size(), [&](int i) {
+        surfaces[i] = decodeImage(blobs[unique[i]]);
+    });
+
+    // failures are left out, the loaders retry and report them
+    for (size_t i = 0; i < unique.size(); i++)
+        if (surfaces[i]) decodedSurfaces[blobs[unique[i]].hash] = surfaces[i];
+    for (size_t i = 0; i < sounds.size(); i++)
+        if (chunks[i]) decodedChunks[assetName(sounds[i])] = chunks[i];
+}
+
+// content hash of an image, decoding it now if decodeAssets did not
+bool imageHash(const std::filesystem::path& name, uint64_t& hash) {
+    auto it = decodedHashes.find(assetName(name));
+    if (it != decodedHashes.end()) {
+        hash = it->second;
+        return true;
+    }
+
+    AssetBlob blob;
+    if (!assetRead(name, blob)) return false;
+    hash = blob.hash;
+    if (!atlasCache.count(hash) && !decodedSurfaces.count(hash))
+        if (SDL_Surface *surf = decodeImage(blob)) decodedSurfaces[hash] = surf;
+    return true;
+}
+
+SDL_Surface* takeSurface(uint64_t hash) {
+    auto it = decodedSurfaces.find(hash);
+    if (it == decodedSurfaces.end()) return NULL;
+    SDL_Surface *surf = it->second;
+    decodedSurfaces.erase(it);
+    return surf;
+}
+
+Mix_Chunk* takeChunk(const std::filesystem::path& name) {
+    auto it = decodedChunks.find(assetName(name));
+    if (it != decodedChunks.end()) {
+        Mix_Chunk *chunk = it->second;
+        decodedChunks.erase(it);
+        return chunk;
+    }
+    SDL_RWops *rw = assetOpen(name);
+    return rw ? Mix_LoadWAV_RW(rw, 1) : NULL;
+}
+
+// free whatever no loader asked for
+void freeDecoded() {
+    for (auto& [hash, surf] : decodedSurfaces) SDL_FreeSurface(surf);
+    for (auto& [path, chunk] : decodedChunks) Mix_FreeChunk(chunk);
+    decodedHashes.clear();
+    decodedSurfaces.clear();
+    decodedChunks.clear();
+}
+
+// load an image into the atlas, or reuse the sprite of the same image, the
+// missing texture sprite if it fails
+bool loadSprite(const std::filesystem::path& path, Assets::Sprite& sprite) {
+    uint64_t hash = 0;
+    SDL_Surface *surf = NULL;
+    if (imageHash(path, hash)) {
+        auto cached = atlasCache.find(hash);
+        if (cached != atlasCache.end()) {
+            sprite = cached->second;
+            atlasBorrow(sprite);
+            return true;
+        }
+        surf = takeSurface(hash);
+    }
+
+    if (surf == NULL) {
+        error_img("IMG_Load failed on " + path.string());
+        sprite = Assets::missingSprite;
+        return false;
+    }
+
+    sprite = atlasAdd(surf, hash);
+    SDL_FreeSurface(surf);
+    return true;
+}
+
+void indexTerrains() {
+    PROFILE_SCOPE("indexTerrains");
+    if (!assetExists("textures"))
         exit_error("Textures directory does not exist");
 
-    if (!std::filesystem::exists(assetPath + "/textures/terrain"))
+    if (!assetExists("textures/terrain"))
         exit_error("Terrain directory does not exist");
 
-    for (const auto& entryVariant : std::filesystem::directory_iterator(assetPath + "/textures/terrain")) {
-        if (!entryVariant.is_directory()) continue;
+    for (const auto& entryVariant : assetList("textures/terrain")) {
+        if (!assetIsDir(entryVariant)) continue;
 
         Assets::TerrainVariant variant;
-        variant.name = entryVariant.path().filename().string();
+        variant.name = entryVariant.filename().string();
+        std::fill(std::begin(variant.tileIndex), std::end(variant.tileIndex), -1);
 
-        for (const auto& entryTile : std::filesystem::directory_iterator(entryVariant.path().string())) {
-            if (!entryTile.is_regular_file()) continue;
-            if (entryTile.path().extension() != ".png") continue;
+        for (const auto& entryTile : assetList(entryVariant)) {
+            if (assetIsDir(entryTile)) continue;
+            if (entryTile.extension() != ".png") continue;
 
             Assets::Tile tile { };
-            tile.name = entryTile.path().stem().string();
-            if ((tile.texture = IMG_LoadTexture(renderer, entryTile.path().string().c_str())) == NULL) {
-                error_img("IMG_LoadTexture failed on assets/terrain/" + variant.name + "/" + tile.name + ".png");
-                continue;
-            }
-
-            if (SDL_QueryTexture(tile.texture, NULL, NULL, &tile.width, &tile.height) < 0) {
-                error_sdl("SDL_QueryTexture failed on assets/terrain/" + variant.name + "/" + tile.name + ".png");
-                continue;
-            }
-
+            tile.name = entryTile.stem().string();
+            // tiles are placed in maps by the first character of their name, the first file wins
+            if (variant.tileIndex[(uint8_t)tile.name[0]] < 0)
+                variant.tileIndex[(uint8_t)tile.name[0]] = variant.terrainTextures.size();
             variant.terrainTextures.push_back(tile);
         }
 
+        terrainVariantIds[variant.name] = Assets::terrainVariants.size();
         Assets::terrainVariants.push_back(variant);
     }
 }
 
+// headless runs only use the tile names
+void loadTerrainVariant(Assets::TerrainVariant& variant) {
+    if (headless) return;
+    PROFILE_SCOPE("loadTerrainVariant");
+
+    std::cout << "Loading terrain variant " << variant.name << "..." << std::endl;
+    std::filesystem::path dir = std::filesystem::path("textures/terrain") / variant.name;
+    decodeAssets({ dir });
+
+    for (Assets::Tile& tile : variant.terrainTextures) {
+        loadSprite(dir / (tile.name + ".png"), tile.sprite);
+        tile.width = tile.sprite.rect.w;
+        tile.height = tile.sprite.rect.h;
+    }
+
+    variant.pages = atlasUpload();
+    freeDecoded();
+}
+
+void releaseTerrainVariant(Assets::TerrainVariant& variant) {
+    atlasRelease(variant.pages);
+    for (Assets::Tile& tile : variant.terrainTextures)
+        tile.sprite = { };
+}
+
 bool sortMaps(const Assets::Map& a, const Assets::Map& b) {
     return a.id < b.id;
 }
 
-void loadMaps(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath + "/campaigns"))
+void loadMaps() {
+    PROFILE_SCOPE("loadMaps");
+    if (!assetExists("campaigns"))
         exit_error("Terrain directory does not exist");
 
-    for (const auto& entryCampaign : std::filesystem::directory_iterator(assetPath + "/campaigns")) {
-        if (!entryCampaign.is_directory()) continue;
+    for (const auto& entryCampaign : assetList("campaigns")) {
+        if (!assetIsDir(entryCampaign)) continue;
 
         Assets::Campaign campaign;
-        campaign.name = entryCampaign.path().filename().string();
+        campaign.name = entryCampaign.filename().string();
         campaign.nameNice = makeNameNice(campaign.name);
 
-        for (const auto& entryMap : std::filesystem::directory_iterator(entryCampaign.path().string())) {
-            if (!entryMap.is_regular_file()) continue;
-            if (entryMap.path().extension() != ".map") continue;
+        for (const auto& entryMap : assetList(entryCampaign)) {
+            if (assetIsDir(entryMap)) continue;
+            if (entryMap.extension() != ".map") continue;
 
             Assets::Map map { };
-            try { map.id = std::stoi(entryMap.path().stem()); }
+            try { map.id = std::stoi(entryMap.stem()); }
             catch (std::invalid_argument) {
-                std::cout << "Map filename NaN: " << entryMap.path().filename() << std::endl;
+                std::cout << "Map filename NaN: " << entryMap.filename() << std::endl;
+                continue;
+            }
+
+            // packed maps were checked by ww1game-pack
+            AssetBlob blob;
+            if (!assetRead(entryMap, blob)) continue;
+            if (blob.entry && blob.entry->type == Bundle::Entry::MAP) {
+                Bundle::unpackMap(blob.entry, blob.data, map);
+                campaign.maps.push_back(map);
                 continue;
             }
 
-            std::ifstream fileMap(entryMap.path().string());
             std::vector<std::string> fileMapLines;
-            std::string line;
-            while (std::getline(fileMap, line))
-                fileMapLines.push_back(line);
+            blobLines(blob, fileMapLines);
 
             if (fileMapLines.size() < 6) {
-                std::cout << "Invalid map format, less than 3 lines: " << entryMap.path().filename() << std::endl;
+                std::cout << "Invalid map format, less than 3 lines: " << entryMap.filename() << std::endl;
                 continue;
             }
 
@@ -129,13 +564,13 @@ void loadMaps(std::string assetPath) {
                 map.map.push_back(fileMapLines[i]);
 
             if (map.map[0].length() < 1) {
-                std::cout << "Invalid map format, at least 1 unit long: " << entryMap.path().filename() << std::endl;
+                std::cout << "Invalid map format, at least 1 unit long: " << entryMap.filename() << std::endl;
                 continue;
             }
 
             for (int i = 0; i < map.map.size(); i++) {
                 if (map.map[i].length() != map.map[0].length()) {
-                    std::cout << "Invalid map format, all map lines should be the same length: " << entryMap.path().stem() << ":" << i << std::endl;
+                    std::cout << "Invalid map format, all map lines should be the same length: " << entryMap.stem() << ":" << i << std::endl;
                     continue;
                 }
             }
@@ -148,276 +583,291 @@ void loadMaps(std::string assetPath) {
 
         std::sort(campaign.maps.begin(), campaign.maps.end(), sortMaps);
 
+        campaignIds[campaign.name] = Assets::campaigns.size();
         Assets::campaigns.push_back(campaign);
     }
 }
 
-void loadCharacterAnimation(const std::filesystem::path& path, std::vector<SDL_Texture*>& anim) {
+void loadCharacterAnimation(const std::filesystem::path& path, std::vector<Assets::Sprite>& anim) {
     std::vector<int> frameNs;
-    for (const auto& entryFrame : std::filesystem::directory_iterator(path.string())) {
-        if (!entryFrame.is_regular_file()) continue;
-        if (entryFrame.path().extension() != ".png") continue;
+    for (const auto& entryFrame : assetList(path)) {
+        if (assetIsDir(entryFrame)) continue;
+        if (entryFrame.extension() != ".png") continue;
 
-        try { frameNs.push_back(std::stoi(entryFrame.path().stem())); }
+        try { frameNs.push_back(std::stoi(entryFrame.stem())); }
         catch (std::invalid_argument) {
-            std::cout << "Frame filename NaN: " << entryFrame.path().filename() << std::endl;
+            std::cout << "Frame filename NaN: " << entryFrame.filename() << std::endl;
             continue;
         }
     }
 
     std::sort(frameNs.begin(), frameNs.end());
 
+    // headless runs only need the frame count
+    if (headless) {
+        anim.resize(anim.size() + frameNs.size());
+        return;
+    }
+
     for (const int& frameN : frameNs) {
-        SDL_Texture *frame;
-        if ((frame = IMG_LoadTexture(renderer, (path / (std::to_string(frameN) + ".png")).string().c_str())) == NULL) {
-            error_img("IMG_LoadTexture failed on " + (path / (std::to_string(frameN) + ".png")).string());
-            anim.push_back(Assets::missingTextureTexture);
-        }
+        Assets::Sprite frame;
+        loadSprite(path / (std::to_string(frameN) + ".png"), frame);
         anim.push_back(frame);
     }
 }
 
+// every frame lasts 1 / ANIM_FPS for now, the tables leave room for per frame timing
+void buildFrameTimes(size_t frames, std::vector<float>& times) {
+    times.resize(frames);
+    for (size_t i = 0; i < frames; i++)
+        times[i] = (i + 1) / (float)ANIM_FPS;
+}
+
 void loadCharacterConfiguration(const std::filesystem::path& path, Assets::Character& character) {
     auto confPath = path / "properties.cfg";
-    if (!std::filesystem::exists(confPath)) {
+    if (!assetExists(confPath)) {
         std::cout << "Properties for character does not exist: " + confPath.string() << std::endl;
         return;
     }
 
-    std::ifstream fileCfg(confPath.string());
-    if (!fileCfg.is_open()) {
+    AssetBlob blob;
+    if (!assetRead(confPath, blob)) {
         std::cout << "Error opening properties for character: " + confPath.string() << std::endl;
         return;
     }
 
-    std::vector<std::string> fileCfgLines;
-    std::string line;
-    while (std::getline(fileCfg, line))
-        fileCfgLines.push_back(line);
-
-    if (fileCfgLines.size() == 0) {
-        std::cout << "Error opening properties for character: " + confPath.string() << std::endl;
-        return;
+    Bundle::Properties properties;
+    if (blob.entry && blob.entry->type == Bundle::Entry::PROPERTIES) {
+        std::memcpy(&properties, blob.data, sizeof(properties));
+    } else {
+        std::vector<std::string> fileCfgLines;
+        blobLines(blob, fileCfgLines);
+        if (!Bundle::parseProperties(fileCfgLines, properties)) {
+            std::cout << "Error parsing config file " << confPath.string() << std::endl;
+            return;
+        }
     }
 
-    try {
-        character.fireFrame = std::stoi(fileCfgLines[0]);
-        character.rpm = std::stof(fileCfgLines[1]);
-        character.roundDamage = std::stoi(fileCfgLines[2]);
-        character.muzzleVel = std::stof(fileCfgLines[3]);
-        character.spread = std::stof(fileCfgLines[4]);
-        character.marchSpeed = std::stof(fileCfgLines[5]);
-        character.range = std::stof(fileCfgLines[6]);
-        character.iHealth = std::stoi(fileCfgLines[7]);
-    } catch (std::exception e) {
-        std::cout << e.what() << " parsing config file " << confPath.string() << std::endl;
-        return;
-    }
+    character.fireFrame = properties.fireFrame;
+    character.rpm = properties.rpm;
+    character.roundDamage = properties.roundDamage;
+    character.muzzleVel = properties.muzzleVel;
+    character.spread = properties.spread;
+    character.marchSpeed = properties.marchSpeed;
+    character.range = properties.range;
+    character.iHealth = properties.iHealth;
 }
 
-void loadCharacters(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath + "/textures/factions"))
+void indexFactions() {
+    PROFILE_SCOPE("indexFactions");
+    if (!assetExists("textures/factions"))
         exit_error("Terrain directory does not exist");
 
-    for (const auto& entryFaction : std::filesystem::directory_iterator(assetPath + "/textures/factions")) {
-        if (!entryFaction.is_directory()) continue;
+    for (const auto& entryFaction : assetList("textures/factions")) {
+        if (!assetIsDir(entryFaction)) continue;
 
         Assets::Faction faction;
         // name
-        faction.name = entryFaction.path().filename().string();
+        faction.name = entryFaction.filename().string();
         faction.nameNice = makeNameNice(faction.name);
-        
-        // flag
-        if (!std::filesystem::exists(entryFaction.path() / "flag.png")) {
-            std::cout << "Warning: No flag texture for " << faction.name << std::endl;
-            faction.flag = Assets::missingTextureTexture;
-            faction.flagHeight = 32;
-        }
+        faction.flagHeight = 32;
 
-        if ((faction.flag = IMG_LoadTexture(renderer, (entryFaction.path() / "flag.png").string().c_str())) == NULL) {
-            error_img("IMG_LoadTexture failed on assets/" + faction.name + "/flag.png");
-            faction.flag = Assets::missingTextureTexture;
-            faction.flagHeight = 32;
-        }
-
-        int flagWidth = 0;
-        if (SDL_QueryTexture(faction.flag, NULL, NULL, &flagWidth, &faction.flagHeight) < 0) {
-            error_sdl("SDL_QueryTexture failed on assets/" + faction.name + "/flag.png");
-            faction.flag = Assets::missingTextureTexture;
-            faction.flagHeight = 32;
-        }
-
-        if (flagWidth != 64) std::cout << "Warning: Flag texture for for " << faction.name << " is not 64 pix wide" << std::endl;
-
-        // characters
-        for (const auto& entryCharacter : std::filesystem::directory_iterator(entryFaction.path().string())) {
-            if (!entryCharacter.is_directory()) continue;
+        // characters, only their properties until the faction is loaded
+        for (const auto& entryCharacter : assetList(entryFaction)) {
+            if (!assetIsDir(entryCharacter)) continue;
 
             Assets::Character character;
-            character.name = entryCharacter.path().stem().string();
+            character.name = entryCharacter.stem().string();
             character.nameNice = makeNameNice(character.name);
             character.fireSnd = Assets::missingSoundSound;
-
-            // idle texture
-            if (!std::filesystem::exists(entryCharacter.path() / "idle.png")) {
-                std::cout << "Warning: No idle texture for " << character.name << std::endl;
-                character.idle = Assets::missingTextureTexture;
-            }
-
-            if ((character.idle = IMG_LoadTexture(renderer, (entryCharacter.path() / "idle.png").string().c_str())) == NULL) {
-                error_img("IMG_LoadTexture failed on assets/" + faction.name + "/" + character.name + "/idle.png");
-                character.idle = Assets::missingTextureTexture;
-            }
-
-            int width, height;
-            if (SDL_QueryTexture(character.idle, NULL, NULL, &width, &height) < 0) {
-                error_sdl("SDL_QueryTexture failed on assets/" + faction.name + "/" + character.name + "/idle.png");
-                character.idle = Assets::missingTextureTexture;
-                character.size.x = 32.0f; character.size.y = 32.0f;
-            }
-            character.size.x = width; character.size.y = height;
-
-            // check animations
-            if (!std::filesystem::exists(entryCharacter.path() / "walk")) {
-                std::cout << "Warning: No walk animation for " << character.name << std::endl;
-                character.march.push_back(Assets::missingTextureTexture);
-            }
-
-            if (!std::filesystem::exists(entryCharacter.path() / "fire")) {
-                std::cout << "Warning: No fire animation for " << character.name << std::endl;
-                character.fire.push_back(Assets::missingTextureTexture);
-            }
-
-            if (!std::filesystem::exists(entryCharacter.path() / "death")) {
-                std::cout << "Warning: No death animation for " << character.name << std::endl;
-                character.death.push_back(Assets::missingTextureTexture);
-            }
-
-            // load animations
-            loadCharacterAnimation(entryCharacter.path() / "walk", character.march);
-            loadCharacterAnimation(entryCharacter.path() / "fire", character.fire);
-            loadCharacterAnimation(entryCharacter.path() / "death", character.death);
+            character.size.x = 32.0f; character.size.y = 32.0f;
 
             // load conf
-            loadCharacterConfiguration(entryCharacter.path(), character);
+            loadCharacterConfiguration(entryCharacter, character);
 
+            faction.characterIds[character.name] = faction.characters.size();
             faction.characters.push_back(character);
         }
 
+        factionIds[faction.name] = Assets::factions.size();
         Assets::factions.push_back(faction);
     }
 }
 
-void loadFonts(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath + "/fonts"))
-        exit_error("Fonts directory does not exist");
-
-    for (const auto& entryFont : std::filesystem::directory_iterator(assetPath + "/fonts")) {
-        if (!entryFont.is_regular_file()) continue;
-        if (entryFont.path().extension() != ".ttf") continue;
-
-        Assets::Font font;
-        font.name = entryFont.path().stem().string();
-        font.size = 12;
-        if ((font.font12 = TTF_OpenFont(entryFont.path().string().c_str(), 12)) == NULL)
-            std::cout << "Error opening font " << entryFont.path().filename() << ": " << TTF_GetError() << std::endl;
-
-        if ((font.font20 = TTF_OpenFont(entryFont.path().string().c_str(), 20)) == NULL)
-            std::cout << "Error opening font " << entryFont.path().filename() << ": " << TTF_GetError() << std::endl;
+// textures, sounds and music of a faction, headless runs only need sizes and frame counts
+void loadFaction(Assets::Faction& faction) {
+    PROFILE_SCOPE("loadFaction");
+    std::cout << "Loading faction " << faction.name << "..." << std::endl;
+    std::filesystem::path entryFaction = std::filesystem::path("textures/factions") / faction.name;
+    std::filesystem::path sfxPath = std::filesystem::path("sounds/sfx/factions") / faction.name;
+    std::filesystem::path musicPath = std::filesystem::path("sounds/music/factions") / faction.name;
+    if (!headless) decodeAssets({ entryFaction, sfxPath });
+
+    // flag
+    if (!headless) {
+        if (!assetExists(entryFaction / "flag.png"))
+            std::cout << "Warning: No flag texture for " << faction.name << std::endl;
 
-        Assets::fonts.push_back(font);
+        if (loadSprite(entryFaction / "flag.png", faction.flag)) {
+            faction.flagHeight = faction.flag.rect.h;
+            if (faction.flag.rect.w != 64) std::cout << "Warning: Flag texture for for " << faction.name << " is not 64 pix wide" << std::endl;
+        } else {
+            faction.flagHeight = 32;
+        }
     }
 
-    for (int i = 0; i < Assets::fonts.size(); i++)
-        if (Assets::fonts[i].name == "default") Assets::defaultFont = Assets::fonts.begin() + i;
-}
-
-void loadSounds(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath + "/sounds"))
-        exit_error("Sounds directory does not exist");
+    // characters
+    for (Assets::Character& character : faction.characters) {
+        std::filesystem::path entryCharacter = entryFaction / character.name;
 
-    if (!std::filesystem::exists(assetPath + "/sounds/sfx"))
-        exit_error("Sfx directory does not exist");
+        // idle texture, headless runs only need its size
+        if (headless) {
+            SDL_Surface *surf = NULL;
+            if ((surf = assetImage(entryCharacter / "idle.png")) == NULL) {
+                error_img("IMG_Load failed on assets/" + faction.name + "/" + character.name + "/idle.png");
+                character.size.x = 32.0f; character.size.y = 32.0f;
+            } else {
+                character.size.x = surf->w; character.size.y = surf->h;
+                SDL_FreeSurface(surf);
+            }
+        } else {
+            if (!assetExists(entryCharacter / "idle.png"))
+                std::cout << "Warning: No idle texture for " << character.name << std::endl;
 
-    if (!std::filesystem::exists(assetPath + "/sounds/sfx/factions"))
-        exit_error("Sfx/factions directory does not exist");
+            if (loadSprite(entryCharacter / "idle.png", character.idle)) {
+                character.size.x = character.idle.rect.w; character.size.y = character.idle.rect.h;
+            } else {
+                character.size.x = 32.0f; character.size.y = 32.0f;
+            }
+        }
 
-    for (const auto& entryFaction : std::filesystem::directory_iterator(assetPath + "/sounds/sfx/factions")) {
-        if (!entryFaction.is_directory()) continue;
-        std::string factionName = entryFaction.path().filename().string();
-        auto faction = getFactionByName(factionName);
+        // check animations
+        if (!assetExists(entryCharacter / "walk")) {
+            std::cout << "Warning: No walk animation for " << character.name << std::endl;
+            character.march.push_back(Assets::missingSprite);
+        }
 
-        for (const auto& entryCharacter : std::filesystem::directory_iterator(entryFaction.path().string())) {
-            if (!entryCharacter.is_directory()) continue;
-            std::string characterName = entryCharacter.path().filename().string();
+        if (!assetExists(entryCharacter / "fire")) {
+            std::cout << "Warning: No fire animation for " << character.name << std::endl;
+            character.fire.push_back(Assets::missingSprite);
+        }
 
-            if (faction == Assets::factions.end()) {
-                std::cout << "Warning: Faction does not exist while loading sounds: " << factionName << std::endl;
-                continue;
-            }
+        if (!assetExists(entryCharacter / "death")) {
+            std::cout << "Warning: No death animation for " << character.name << std::endl;
+            character.death.push_back(Assets::missingSprite);
+        }
 
-            auto character = getCharacterByNameAndFaction(characterName, faction);
-            if (character == faction->characters.end()) {
-                std::cout << "Warning: Character does not exist while loading sounds: " << characterName << std::endl;
-                continue;
-            }
+        // load animations
+        loadCharacterAnimation(entryCharacter / "walk", character.march);
+        loadCharacterAnimation(entryCharacter / "fire", character.fire);
+        loadCharacterAnimation(entryCharacter / "death", character.death);
+        buildFrameTimes(character.march.size(), character.marchTimes);
+        buildFrameTimes(character.fire.size(), character.fireTimes);
+        buildFrameTimes(character.death.size(), character.deathTimes);
 
-            if (!std::filesystem::exists(entryCharacter.path() / "fire.ogg")) {
-                std::cout << "Warning: No fire sound for " << character->name << std::endl;
-                character->fireSnd = Assets::missingSoundSound;
-                continue;
-            }
+        if (headless) continue;
 
-            if ((character->fireSnd = Mix_LoadWAV((entryCharacter.path() / "fire.ogg").string().c_str())) == NULL) {
-                std::cout << "Error opening " << (entryCharacter.path() / "fire.ogg").string() << ": " << SDL_GetError() << std::endl;
-                character->fireSnd = Assets::missingSoundSound;
-            }
+        // fire sound
+        if (!assetExists(sfxPath / character.name / "fire.ogg")) {
+            std::cout << "Warning: No fire sound for " << character.name << std::endl;
+            character.fireSnd = Assets::missingSoundSound;
+        } else if ((character.fireSnd = takeChunk(sfxPath / character.name / "fire.ogg")) == NULL) {
+            std::cout << "Error opening " << (sfxPath / character.name / "fire.ogg").string() << ": " << SDL_GetError() << std::endl;
+            character.fireSnd = Assets::missingSoundSound;
         }
     }
 
-    if (!std::filesystem::exists(assetPath + "/sounds/music"))
-        exit_error("Music directory does not exist");
+    if (headless) return;
+
+    // music
+    if (assetExists(musicPath / "victory.ogg")) {
+        SDL_RWops *rw = assetOpen(musicPath / "victory.ogg");
+        if (rw == NULL || (faction.victoryMusic.track = Mix_LoadMUS_RW(rw, 1)) == NULL) {
+            std::cout << "Error opening " << (musicPath / "victory.ogg").string() << ": " << SDL_GetError() << std::endl;
+            faction.victoryMusic.track = Assets::missingMusicMusic;
+        }
+    } else {
+        std::cout << "Warning: No victory music for " << faction.name << std::endl;
+        faction.victoryMusic.track = Assets::missingMusicMusic;
+    }
 
-    if (!std::filesystem::exists(assetPath + "/sounds/music/factions"))
-        exit_error("Music/factions directory does not exist");
+    for (const auto& entryTrack : assetList(musicPath)) {
+        if (assetIsDir(entryTrack)) continue;
+        if (entryTrack.extension() != ".ogg") continue;
+        if (entryTrack.stem() == "victory") continue;
 
-    for (const auto& entryFaction : std::filesystem::directory_iterator(assetPath + "/sounds/music/factions")) {
-        if (!entryFaction.is_directory()) continue;
-        std::string factionName = entryFaction.path().filename().string();
-        auto faction = getFactionByName(factionName);
+        Assets::MusicTrack track;
+        track.name = entryTrack.stem().string();
 
-        if (faction == Assets::factions.end()) {
-            std::cout << "Warning: Faction does not exist while loading music tracks: " << factionName << std::endl;
+        SDL_RWops *rw = assetOpen(entryTrack);
+        if (rw == NULL || (track.track = Mix_LoadMUS_RW(rw, 1)) == NULL) {
+            std::cout << "Error opening " << entryTrack.string() << ": " << SDL_GetError() << std::endl;
             continue;
         }
 
-        if (std::filesystem::exists(entryFaction.path() / "victory.ogg")) {
-            if ((faction->victoryMusic.track = Mix_LoadMUS((entryFaction.path() / "victory.ogg").string().c_str())) == NULL) {
-                std::cout << "Error opening " << (entryFaction.path() / "victory.ogg").string() << ": " << SDL_GetError() << std::endl;
-            }
-        } else {
-            std::cout << "Warning: No victory music for " << faction->name << std::endl;
-            faction->victoryMusic.track = Assets::missingMusicMusic;
-            
+        // track.duration = Mix_MusicDuration() but its SDL_mixer version 2.6.0 but the newest in debian is 2.0.4, well fuck
+
+        faction.gameplayMusic.push_back(track);
+    }
+
+    faction.pages = atlasUpload();
+    freeDecoded();
+}
+
+// back to what indexFactions left, freeing a playing chunk or track halts it
+void releaseFaction(Assets::Faction& faction) {
+    atlasRelease(faction.pages);
+    faction.flag = { };
+
+    for (Assets::Character& character : faction.characters) {
+        character.idle = { };
+        character.march.clear();
+        character.fire.clear();
+        character.death.clear();
+        character.marchTimes.clear();
+        character.fireTimes.clear();
+        character.deathTimes.clear();
+        if (character.fireSnd && character.fireSnd != Assets::missingSoundSound) {
+            Audio::forget(character.fireSnd);
+            Mix_FreeChunk(character.fireSnd);
         }
+        character.fireSnd = Assets::missingSoundSound;
+    }
+
+    if (faction.victoryMusic.track && faction.victoryMusic.track != Assets::missingMusicMusic) Mix_FreeMusic(faction.victoryMusic.track);
+    faction.victoryMusic.track = NULL;
+    for (Assets::MusicTrack& track : faction.gameplayMusic)
+        Mix_FreeMusic(track.track);
+    faction.gameplayMusic.clear();
+}
 
-        for (const auto& entryTrack : std::filesystem::directory_iterator(entryFaction.path().string())) {
-            if (!entryTrack.is_regular_file()) continue;
-            if (entryTrack.path().extension() != ".ogg") continue;
-            if (entryTrack.path().stem() == "victory") continue;
+void loadFonts() {
+    PROFILE_SCOPE("loadFonts");
+    if (!assetExists("fonts"))
+        exit_error("Fonts directory does not exist");
 
-            Assets::MusicTrack track;
-            track.name = entryTrack.path().stem().string();
+    for (const auto& entryFont : assetList("fonts")) {
+        if (assetIsDir(entryFont)) continue;
+        if (entryFont.extension() != ".ttf") continue;
 
-            if ((track.track = Mix_LoadMUS(entryTrack.path().string().c_str())) == NULL) {
-                std::cout << "Error opening " << entryTrack.path().string() << ": " << SDL_GetError() << std::endl;
-                continue;
-            }
+        Assets::Font font;
+        font.name = entryFont.stem().string();
+        font.size = 12;
+        SDL_RWops *rw = NULL;
+        if ((rw = assetOpen(entryFont)) == NULL || (font.font12 = TTF_OpenFontRW(rw, 1, 12)) == NULL)
+            std::cout << "Error opening font " << entryFont.filename() << ": " << TTF_GetError() << std::endl;
 
-            // track.duration = Mix_MusicDuration() but its SDL_mixer version 2.6.0 but the newest in debian is 2.0.4, well fuck
+        if ((rw = assetOpen(entryFont)) == NULL || (font.font20 = TTF_OpenFontRW(rw, 1, 20)) == NULL)
+            std::cout << "Error opening font " << entryFont.filename() << ": " << TTF_GetError() << std::endl;
 
-            faction->gameplayMusic.push_back(track);
-        }
+        Assets::fonts.push_back(font);
+    }
+
+    for (int i = 0; i < Assets::fonts.size(); i++)
+        if (Assets::fonts[i].name == "default") Assets::defaultFont = i;
+    if (Assets::defaultFont < 0 && Assets::fonts.size() > 0) {
+        warning("No default font, using " + Assets::fonts[0].name);
+        Assets::defaultFont = 0;
     }
 }
 
@@ -452,90 +902,167 @@ SDL_Color getPixel(SDL_Surface *surface, int x, int y) {
     return rgb;
 }
 
-void loadBackgrounds(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath + "/textures/backgrounds"))
+void indexBackgrounds() {
+    PROFILE_SCOPE("indexBackgrounds");
+    if (!assetExists("textures/backgrounds"))
         exit_error("Backgrounds directory does not exist");
 
-    for (const auto& entryBackground : std::filesystem::directory_iterator(assetPath + "/textures/backgrounds")) {
-        if (!entryBackground.is_regular_file()) continue;
-        if (entryBackground.path().extension() != ".png") continue;
+    for (const auto& entryBackground : assetList("textures/backgrounds")) {
+        if (assetIsDir(entryBackground)) continue;
+        if (entryBackground.extension() != ".png") continue;
 
         Assets::Background background;
-        background.name = entryBackground.path().stem().string();
+        background.name = entryBackground.stem().string();
+        backgroundIds[background.name] = Assets::backgrounds.size();
+        Assets::backgrounds.push_back(background);
+    }
+}
 
-        SDL_Surface *surf = NULL;
-        if ((surf = IMG_Load(entryBackground.path().string().c_str())) == NULL) {
-            error_img("IMG_Load failed on assets/textures/backgrounds/" + background.name + ".png");
-            continue;
-        }
+void Assets::acquireBackground(Assets::Background& background) {
+    if (background.users++ > 0) return;
+    PROFILE_SCOPE("acquireBackground");
 
-        if ((background.texture = SDL_CreateTextureFromSurface(renderer, surf)) == NULL) {
-            error_img("SDL_CreateTextureFromSurface failed on assets/textures/backgrounds/" + background.name + ".png");
-            continue;
-        }
+    std::string name = "textures/backgrounds/" + background.name + ".png";
 
-        if (SDL_QueryTexture(background.texture, NULL, NULL, &background.width, &background.height) < 0) {
-            error_sdl("SDL_QueryTexture failed on assets/textures/backgrounds/" + background.name + ".png");
-            continue;
+    SDL_Surface *surf = NULL;
+    if ((surf = assetImage(name)) == NULL) {
+        error_img("IMG_Load failed on assets/" + name);
+        return;
+    }
+
+    background.width = surf->w;
+    background.height = surf->h;
+    background.skyColor = getPixel(surf, 0, 0);
+    background.skyColor.a = SDL_ALPHA_OPAQUE;
+
+    if ((background.texture = SDL_CreateTextureFromSurface(renderer, surf)) == NULL)
+        error_img("SDL_CreateTextureFromSurface failed on assets/" + name);
+    SDL_FreeSurface(surf);
+}
+
+void Assets::releaseBackground(Assets::Background& background) {
+    if (background.users == 0 || --background.users > 0) return;
+    if (background.texture) SDL_DestroyTexture(background.texture);
+    background.texture = NULL;
+}
+
+// what maps reference by name, once everything they can reference is indexed
+void resolveMaps() {
+    for (Assets::Campaign& campaign : Assets::campaigns) {
+        for (Assets::Map& map : campaign.maps) {
+            map.terrainVariant = Assets::findTerrainVariant(map.terrainVariantName);
+            map.background = Assets::findBackground(map.backgroundName);
+            map.friendlyFaction = Assets::findFaction(map.friendlyFactionName);
+            map.enemyFaction = Assets::findFaction(map.enemyFactionName);
         }
+    }
+}
 
-        background.skyColor = getPixel(surf, 0, 0);
-        background.skyColor.a = SDL_ALPHA_OPAQUE;
+void Assets::acquireMap(const Assets::Map& map) {
+    if (map.terrainVariant >= 0 && getTerrainVariant(map.terrainVariant).users++ == 0)
+        loadTerrainVariant(getTerrainVariant(map.terrainVariant));
 
-        Assets::backgrounds.push_back(background);
+    // both sides can be the same faction
+    for (Assets::FactionId faction : { map.friendlyFaction, map.enemyFaction })
+        if (faction >= 0 && getFaction(faction).users++ == 0)
+            loadFaction(getFaction(faction));
+
+    if (headless) return;
+    if (map.background >= 0) Assets::acquireBackground(Assets::backgrounds[map.background]);
+}
+
+void Assets::releaseMap(const Assets::Map& map) {
+    if (map.terrainVariant >= 0) {
+        Assets::TerrainVariant& variant = getTerrainVariant(map.terrainVariant);
+        if (variant.users > 0 && --variant.users == 0) releaseTerrainVariant(variant);
     }
+
+    for (Assets::FactionId faction : { map.friendlyFaction, map.enemyFaction })
+        if (faction >= 0 && getFaction(faction).users > 0 && --getFaction(faction).users == 0)
+            releaseFaction(getFaction(faction));
+
+    if (headless) return;
+    if (map.background >= 0) Assets::releaseBackground(Assets::backgrounds[map.background]);
 }
 
-bool Assets::load(std::string assetPath) {
-    if (!std::filesystem::exists(assetPath)) {
-        warning("Asset directory " + assetPath + " does not exist");
-        return true;
+bool Assets::load(const std::vector<std::string>& assetPaths) {
+    PROFILE_SCOPE("Assets::load");
+    for (const std::string& assetPath : assetPaths) {
+        if (!std::filesystem::is_directory(assetPath)) {
+            warning("Asset directory " + assetPath + " does not exist");
+            continue;
+        }
+        mountSource(assetPath);
+    }
+    if (assetSources.size() == 0) return true;
+
+    for (auto& [dir, children] : assetDirs)
+        std::sort(children.begin(), children.end());
+    std::cout << "Mounted " << assetSources.size() << " asset paths, " << assetFiles.size() << " files" << std::endl;
+
+    // only an index of factions, terrain variants and backgrounds, they are
+    // loaded when a map needs them, see acquireMap
+    // headless runs need no textures, fonts or audio, only maps and characters
+    if (headless) {
+        std::cout << "Indexing terrains..." << std::endl;
+        indexTerrains();
+        std::cout << "Loading maps..." << std::endl;
+        loadMaps();
+        std::cout << "Indexing factions..." << std::endl;
+        indexFactions();
+        resolveMaps();
+        return false;
     }
 
     // Load placeholders
-    if (!std::filesystem::exists(assetPath + "/missing_texture.png"))
+    if (!assetExists("missing_texture.png"))
         warning("Missing texture placeholder texture missing");
 
-    if ((Assets::missingTextureTexture = IMG_LoadTexture(renderer, (assetPath + "/missing_texture.png").c_str())) == NULL)
-        error_img("IMG_LoadTexture failed on missing_texture");
+    SDL_Surface *missingSurface = assetImage("missing_texture.png");
+    if (missingSurface == NULL || (Assets::missingTextureTexture = SDL_CreateTextureFromSurface(renderer, missingSurface)) == NULL)
+        error_img("Loading missing_texture failed");
+    if (missingSurface) SDL_FreeSurface(missingSurface);
+
+    // atlas pages no bigger than the renderer allows
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0 && info.max_texture_height > 0)
+        atlasPageSize = std::min({ atlasPageSize, info.max_texture_width, info.max_texture_height });
+
+    loadSprite("missing_texture.png", Assets::missingSprite);
 
-    if (!std::filesystem::exists(assetPath + "/missing_sound.ogg"))
+    if (!assetExists("missing_sound.ogg"))
         warning("Missing sound placeholder texture missing");
 
-    if ((Assets::missingSoundSound = Mix_LoadWAV((assetPath + "/missing_sound.ogg").c_str())) == NULL)
+    if ((Assets::missingSoundSound = takeChunk("missing_sound.ogg")) == NULL)
         warning("Mix_LoadWAV failed on missing_sound");
 
-    if ((Assets::missingMusicMusic = Mix_LoadMUS((assetPath + "/missing_sound.ogg").c_str())) == NULL)
+    SDL_RWops *missingMusic = assetOpen("missing_sound.ogg");
+    if (missingMusic == NULL || (Assets::missingMusicMusic = Mix_LoadMUS_RW(missingMusic, 1)) == NULL)
         warning("Mix_LoadMUS failed on missing_sound");
 
-    std::cout << "Loading terrains..." << std::endl;
-    loadTerrains(assetPath);
+    std::cout << "Indexing terrains..." << std::endl;
+    indexTerrains();
     std::cout << "Loading maps..." << std::endl;
-    loadMaps(assetPath);
-    std::cout << "Loading characters..." << std::endl;
-    loadCharacters(assetPath);
+    loadMaps();
+    std::cout << "Indexing factions..." << std::endl;
+    indexFactions();
     std::cout << "Loading fonts..." << std::endl;
-    loadFonts(assetPath);
-    std::cout << "Loading sounds..." << std::endl;
-    loadSounds(assetPath);
-    std::cout << "Loading backgrounds..." << std::endl;
-    loadBackgrounds(assetPath);
+    loadFonts();
+    std::cout << "Indexing backgrounds..." << std::endl;
+    indexBackgrounds();
+    resolveMaps();
 
-    if (!std::filesystem::exists(assetPath + "/textures/bullet.png"))
+    if (!assetExists("textures/bullet.png"))
         warning("Bullet texture missing");
 
-    if ((Assets::bulletTexture = IMG_LoadTexture(renderer, (assetPath + "/textures/bullet.png").c_str())) == NULL) {
-        error_img("IMG_LoadTexture failed on assets/textures/bullet.png");
-        Assets::bulletTexture = Assets::missingTextureTexture;
-    }
+    loadSprite("textures/bullet.png", Assets::bulletSprite);
 
-    if (!std::filesystem::exists(assetPath + "/textures/flagpole.png"))
+    if (!assetExists("textures/flagpole.png"))
         warning("Bullet texture missing");
 
-    if ((Assets::flagpoleTexture = IMG_LoadTexture(renderer, (assetPath + "/textures/flagpole.png").c_str())) == NULL) {
-        error_img("IMG_LoadTexture failed on assets/textures/flagpole.png");
-        Assets::flagpoleTexture = Assets::missingTextureTexture;
-    }
+    loadSprite("textures/flagpole.png", Assets::flagpoleSprite);
+
+    atlasUpload();
 
     return false;
 }
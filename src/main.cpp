@@ -25,16 +25,38 @@
 #include "main.hpp"
 
 #include <iostream>
+#include <cstdlib>
 
 bool debug = true;
+bool headless = false;
+
+void printUsage(const char *argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl <<
+        "\t--headless          run the simulation without window, textures or audio" << std::endl <<
+        "\t--campaign <name>   campaign to run headless (default first)" << std::endl <<
+        "\t--map <n>           map index in the campaign (default 0)" << std::endl <<
+        "\t--ticks <n>         ticks to simulate (default 10000)" << std::endl <<
+        "\t--tick-rate <hz>    simulation ticks per second (default 60)" << std::endl <<
+        "\t--max-fps <n>       render frame rate cap, 0 for uncapped (default 0)" << std::endl <<
+        "\t--threads <n>       simulation threads, 0 for one per core (default 0)" << std::endl <<
+        "\t--seed <n>          random seed (default 0)" << std::endl <<
+        "\t--soldiers <n>      soldiers spawned per side (default 100)" << std::endl <<
+        "\t--spawn-wave <n>    soldiers spawned per side each wave (default 5)" << std::endl <<
+        "\t--spawn-every <n>   ticks between spawn waves (default 60)" << std::endl <<
+        "\t--advance-every <n> ticks between orders to advance a trench, 0 to hold (default 600)" << std::endl <<
+        "\t--bench <name>      run a headless microbenchmark instead of a battle: collision, bullets" << std::endl <<
+        "\t--audio-range <px>  gunfire further offscreen than this is not played (default 1000)" << std::endl <<
+        "\t--profile <file>    record scoped timings, written as a Chrome trace at exit (and on P in game)" << std::endl;
+}
 
+// what was indexed, textures and sounds are only loaded for a match
 void printAssets() {
     std::cout << "Assets:" << std::endl;
     std::cout << "\tTerrain variants [" << Assets::terrainVariants.size() << "]:" << std::endl;
     for (const Assets::TerrainVariant& tvar : Assets::terrainVariants) {
         std::cout << "\t\t" << tvar.name << " [" << tvar.terrainTextures.size() << "]:" << std::endl;
         for (const Assets::Tile& tx : tvar.terrainTextures)
-            std::cout << "\t\t\t" << tx.name[0] << ": " << tx.name << " " << tx.width << "x" << tx.height << std::endl;
+            std::cout << "\t\t\t" << tx.name[0] << ": " << tx.name << std::endl;
     }
 
     std::cout << "\tCampaigns [" << Assets::campaigns.size() << "]:" << std::endl;
@@ -46,14 +68,9 @@ void printAssets() {
 
     std::cout << "\tFactions [" << Assets::factions.size() << "]:" << std::endl;
     for (const Assets::Faction& f : Assets::factions) {
-        std::cout << "\t\t" << f.name << ": \"" << f.nameNice << "\" " << std::string(f.flag != Assets::missingTextureTexture ? "flag " : " ") <<  "[" << f.characters.size() << "]:" << std::endl;
+        std::cout << "\t\t" << f.name << ": \"" << f.nameNice << "\" [" << f.characters.size() << "]:" << std::endl;
         for (const Assets::Character& c : f.characters)
-            std::cout << "\t\t\t" << c.name << ": \"" << c.nameNice << "\" idle walk[" << c.march.size() << "] fire[" << c.fire.size() << "] death[" << c.death.size() << "] " << c.size.x << "x" << c.size.y <<
-                " " << (c.fireSnd == Assets::missingSoundSound ? "(missing fire snd)" : "firesnd") << std::endl;
-        std::cout << "\t\t\tMusic [" << f.gameplayMusic.size() + 1 << "]:" << std::endl;
-        std::cout << "\t\t\t\tvictory" << std::endl;
-        for (const Assets::MusicTrack& t : f.gameplayMusic)
-            std::cout << "\t\t\t\t" << t.name << std::endl;
+            std::cout << "\t\t\t" << c.name << ": \"" << c.nameNice << "\" health " << c.iHealth << ", range " << c.range << ", rpm " << c.rpm << std::endl;
     }
 
     std::cout << "\tFonts [" << Assets::fonts.size() << "]:" << std::endl;
@@ -62,7 +79,7 @@ void printAssets() {
 
     std::cout << "\tBackgrounds [" << Assets::backgrounds.size() << "]:" << std::endl;
     for (const Assets::Background& b : Assets::backgrounds)
-        std::cout << "\t\t" << b.name << ": " << b.width << "x" << b.height << std::endl;
+        std::cout << "\t\t" << b.name << std::endl;
 }
 
 int main(int argc, const char **argv) {
@@ -71,18 +88,60 @@ int main(int argc, const char **argv) {
         "This is free software: you are free to change and redistribute it. "  << std::endl <<
         "This program comes with ABSOLUTELY NO WARRANTY."  << std::endl;
 
-    Renderer::initSDL();
+    Headless::Options headlessOptions { "", 0, 10000, 0, 100, 5, 60, 600, "" };
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--headless") headless = true;
+            else if (arg == "--campaign" && hasValue) headlessOptions.campaign = argv[++i];
+            else if (arg == "--map" && hasValue) headlessOptions.map = std::stoi(argv[++i]);
+            else if (arg == "--ticks" && hasValue) headlessOptions.ticks = std::stoi(argv[++i]);
+            else if (arg == "--tick-rate" && hasValue) Game::tickRate = std::stof(argv[++i]);
+            else if (arg == "--max-fps" && hasValue) maxFps = std::stoi(argv[++i]);
+            else if (arg == "--threads" && hasValue) threads = std::stoi(argv[++i]);
+            else if (arg == "--seed" && hasValue) headlessOptions.seed = std::stoul(argv[++i]);
+            else if (arg == "--soldiers" && hasValue) headlessOptions.soldiers = std::stoi(argv[++i]);
+            else if (arg == "--spawn-wave" && hasValue) headlessOptions.spawnWave = std::stoi(argv[++i]);
+            else if (arg == "--spawn-every" && hasValue) headlessOptions.spawnInterval = std::stoi(argv[++i]);
+            else if (arg == "--advance-every" && hasValue) headlessOptions.advanceInterval = std::stoi(argv[++i]);
+            else if (arg == "--bench" && hasValue) { headless = true; headlessOptions.bench = argv[++i]; }
+            else if (arg == "--audio-range" && hasValue) Audio::cullDistance = std::stof(argv[++i]);
+            else if (arg == "--profile" && hasValue) Profiler::start(argv[++i]);
+            else {
+                printUsage(argv[0]);
+                return arg == "--help" ? 0 : 1;
+            }
+        } catch (std::exception& e) {
+            std::cout << "Invalid value for " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (Game::tickRate <= 0.0f) exit_error("Error: Tick rate must be positive");
+    if (Audio::cullDistance < 0.0f) exit_error("Error: Audio range can't be negative");
+
+    // workers are joined at exit, also when exit_error bails out
+    Jobs::init(threads);
+    std::atexit(Jobs::destroy);
+    std::atexit(Profiler::dump);    // runs first, while the workers still sleep
 
-    for (std::string path : (std::vector<std::string>)ASSET_SEARCH_PATHS)
-        Assets::load(path);
+    if (headless) Headless::initSDL();
+    else Renderer::initSDL();
+
+    Assets::load(ASSET_SEARCH_PATHS);
     printAssets();
 
     if (Assets::campaigns.size() == 0) exit_error("Error: No assets found.");
 
-    Game::selectedCampaign = Assets::campaigns.end();
-
-    Game::friendlyFaction = Assets::factions.end();
-    Game::enemyFaction = Assets::factions.end();
+    if (headless) {
+        int ret = Headless::run(headlessOptions);
+        Headless::destroySDL();
+        return ret;
+    }
 
     Renderer::setup();
     Renderer::loop();
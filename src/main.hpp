@@ -30,8 +30,13 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
 
 // == Macros
+// merged into one asset tree, a file in a later path shadows the same file in an earlier one
 #define ASSET_SEARCH_PATHS  { \
     "../assets", \
     "./assets", \
@@ -40,7 +45,10 @@
     "/tmp/ww1game/assets/" \
 }
 
+#define BUNDLE_FILENAME     "bundle.ww1pack"   // packed asset tree, see ww1game-pack
+
 #define TILE_SIZE   32
+#define ANIM_FPS    7
 
 // == Types
 struct vector {
@@ -82,6 +90,10 @@ struct vector {
     }
 };
 
+inline vector lerp(const vector& a, const vector& b, float t) {
+    return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+}
+
 inline vector vectorFromPolar(const vector& v) {
     vector t;
     t.x = cos(v.x) * v.y;
@@ -89,16 +101,176 @@ inline vector vectorFromPolar(const vector& v) {
     return t;
 }
 
+// counter based random numbers (Philox4x32-10). A draw is a pure function of
+// the match seed and what it is for (entity, tick, purpose), so battles come
+// out the same whatever the thread count or the order entities are updated in.
+// No state and no tables, loops over entities vectorize.
+namespace Random {
+    enum Purpose : uint32_t { SOLDIER_VARIATION, AIM };
+
+    inline void philox(uint32_t ctr[4], uint32_t key0, uint32_t key1) {
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = uint64_t(0xD2511F53) * ctr[0];
+            uint64_t p1 = uint64_t(0xCD9E8D57) * ctr[2];
+            uint32_t x0 = uint32_t(p1 >> 32) ^ ctr[1] ^ key0;
+            uint32_t x2 = uint32_t(p0 >> 32) ^ ctr[3] ^ key1;
+            ctr[0] = x0; ctr[1] = uint32_t(p1);
+            ctr[2] = x2; ctr[3] = uint32_t(p0);
+            key0 += 0x9E3779B9; key1 += 0xBB67AE85;
+        }
+    }
+
+    // standard normal, Box-Muller on the first two words
+    inline float gauss(uint32_t seed, uint32_t entity, uint32_t tick, Purpose purpose) {
+        uint32_t ctr[4] = { entity, tick, purpose, 0 };
+        philox(ctr, seed, 0);
+        float u1 = ((ctr[0] >> 8) + 1) * (1.0f / 16777216.0f);    // (0, 1], log stays finite
+        float u2 = (ctr[1] >> 8) * (1.0f / 16777216.0f);
+        return std::sqrt(-2.0f * std::log(u1)) * std::cos(float(2.0 * M_PI) * u2);
+    }
+}
+
+// generational reference to an entity in a Pool, stale once the entity is removed
+struct Handle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// dense entity storage with stable handles. Removal only marks the entity,
+// compact() swap-and-pops the marked ones at the end of the tick, so
+// iteration stays valid and dense and capacity is reused between ticks
+template<typename T>
+class Pool {
+public:
+    typedef typename std::vector<T>::iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    Handle add(const T& item) {
+        uint32_t slot;
+        if (freeSlots.size() > 0) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = slotIndex.size();
+            slotIndex.push_back(0);
+            slotGeneration.push_back(0);
+        }
+
+        slotIndex[slot] = items.size();
+        items.push_back(item);
+        itemSlot.push_back(slot);
+        itemRemoved.push_back(false);
+        return { slot, slotGeneration[slot] };
+    }
+
+    // nullptr if the handle is stale
+    T* get(const Handle& handle) {
+        if (handle.slot >= slotIndex.size() || slotGeneration[handle.slot] != handle.generation) return nullptr;
+        return &items[slotIndex[handle.slot]];
+    }
+
+    Handle handle(size_t index) const {
+        return { itemSlot[index], slotGeneration[itemSlot[index]] };
+    }
+
+    void remove(size_t index) {
+        if (itemRemoved[index]) return;
+        itemRemoved[index] = true;
+        removed.push_back(index);
+    }
+
+    bool isRemoved(size_t index) const {
+        return itemRemoved[index];
+    }
+
+    void compact() {
+        // highest index first, so the last item moved into a hole is never itself pending
+        std::sort(removed.begin(), removed.end(), [](size_t a, size_t b) { return a > b; });
+        for (size_t index : removed) {
+            uint32_t slot = itemSlot[index];
+            slotGeneration[slot]++;
+            freeSlots.push_back(slot);
+
+            size_t last = items.size() - 1;
+            if (index != last) {
+                items[index] = std::move(items[last]);
+                itemSlot[index] = itemSlot[last];
+                itemRemoved[index] = itemRemoved[last];
+                slotIndex[itemSlot[index]] = index;
+            }
+            items.pop_back();
+            itemSlot.pop_back();
+            itemRemoved.pop_back();
+        }
+        removed.clear();
+    }
+
+    void clear() {
+        for (size_t i = 0; i < items.size(); i++) remove(i);
+        compact();
+    }
+
+    size_t size() const { return items.size(); }
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    iterator begin() { return items.begin(); }
+    iterator end() { return items.end(); }
+    const_iterator begin() const { return items.begin(); }
+    const_iterator end() const { return items.end(); }
+
+private:
+    std::vector<T> items;
+    std::vector<uint32_t> itemSlot;         // dense index -> slot
+    std::vector<bool> itemRemoved;
+    std::vector<uint32_t> slotIndex;        // slot -> dense index
+    std::vector<uint32_t> slotGeneration;
+    std::vector<uint32_t> freeSlots;
+    std::vector<size_t> removed;            // dense indices pending removal
+};
+
 namespace Assets {
+    // small integer handles into the asset vectors, which are only filled
+    // while loading so a handle stays valid for the whole run, -1 for none
+    typedef int16_t TerrainVariantId;
+    typedef int16_t CampaignId;
+    typedef int16_t FactionId;
+    typedef int16_t FontId;
+    typedef int16_t BackgroundId;
+
+    struct CharacterId {
+        FactionId faction = -1;
+        int16_t character = -1;     // index in the faction's characters
+    };
+
+    // a region of one of the atlas pages
+    struct Sprite {
+        int page = -1;                  // index in atlasPages, -1 for none
+        SDL_Rect rect { 0, 0, 0, 0 };
+
+        bool operator==(const Sprite& right) const { return page == right.page && rect.x == right.rect.x && rect.y == right.rect.y; }
+        bool operator!=(const Sprite& right) const { return !(*this == right); }
+    };
+
+    struct AtlasPage {
+        SDL_Texture *texture = NULL;    // NULL for a free slot
+        int width = 0, height = 0;
+        int users = 0;                  // loaded groups with sprites in it
+    };
+
     struct Tile {
         std::string name;
         int width, height;
-        SDL_Texture *texture;
+        Sprite sprite;
     };
 
+    // factions, terrain variants and backgrounds are indexed at startup and
+    // only fully loaded while a map that references them holds them
     struct TerrainVariant {
         std::string name;
         std::vector<Tile> terrainTextures;
+        int16_t tileIndex[256];     // map character -> index in terrainTextures, -1 for none
+        int users = 0;              // loaded while > 0
+        std::vector<int> pages;     // atlas pages its sprites are in
     };
 
     struct Map {
@@ -108,6 +280,10 @@ namespace Assets {
         std::string backgroundName;
         std::string friendlyFactionName;
         std::string enemyFactionName;
+        // the names above resolved once everything is indexed
+        TerrainVariantId terrainVariant = -1;
+        BackgroundId background = -1;
+        FactionId friendlyFaction = -1, enemyFaction = -1;
         int width, height;
         std::vector<std::string> map;
     };
@@ -122,10 +298,14 @@ namespace Assets {
         std::string name;
         std::string nameNice;
         vector size;
-        SDL_Texture *idle;
-        std::vector<SDL_Texture*> march;
-        std::vector<SDL_Texture*> fire;
-        std::vector<SDL_Texture*> death;
+        Sprite idle;
+        std::vector<Sprite> march;
+        std::vector<Sprite> fire;
+        std::vector<Sprite> death;
+        // when each frame of a clip ends, in seconds from the start of the clip
+        std::vector<float> marchTimes;
+        std::vector<float> fireTimes;
+        std::vector<float> deathTimes;
         Mix_Chunk *fireSnd;
         int fireFrame;
 
@@ -147,11 +327,14 @@ namespace Assets {
     struct Faction {
         std::string name;
         std::string nameNice;
-        SDL_Texture* flag;  // always 64 width
+        Sprite flag;        // always 64 width
         int flagHeight;
         MusicTrack victoryMusic;
         std::vector<MusicTrack> gameplayMusic;
         std::vector<Character> characters;
+        std::unordered_map<std::string, int16_t> characterIds;     // name -> index in characters
+        int users = 0;
+        std::vector<int> pages;
     };
 
     struct Font {
@@ -165,21 +348,26 @@ namespace Assets {
         std::string name;
         int width, height;
         SDL_Color skyColor;
-        SDL_Texture *texture;
+        SDL_Texture *texture = NULL;
+        int users = 0;
     };
 }
 
 namespace Game {
     struct Soldier {
         vector pos;
+        vector prevPos; // pos at the start of the tick, to interpolate rendering
         vector vel;     // to be used in the future for implementing explosions
+        uint32_t id;    // spawn order in the match, keys its random draws
         float rand;     // a gaussian random number associated with the soldier
         bool friendly;  // false = enemy
-        std::vector<Assets::Character>::iterator character;
+        Assets::CharacterId character;
         enum SoldierState { IDLE, MARCHING, FIRING, DYING } prevState, state;  // 0 idle, 1 running, 2 firing, 3 dying
-        int frameCounter;
+        float animTime;     // seconds into the current clip, advanced by the tick
+        int frameCounter;   // frame of the clip at animTime, what rendering reads
         float cooldownTime;
         int health;
+        int pathIndex;  // waypoint the soldier is marching to in its side's map path
     };
 
     struct MapPathPoint {
@@ -188,17 +376,38 @@ namespace Game {
         vector pos;
     };
 
-    struct Bullet {
-        vector pos;
-        vector vel;
-        int damage;
-        bool fromEnemy;
+    // bullets in flight as parallel arrays, so integration streams over
+    // contiguous floats. Removal is deferred like Pool, compact() at the end
+    // of the tick swap-and-pops every array
+    struct Bullets {
+        std::vector<float> x, y, vx, vy;
+        std::vector<float> prevX, prevY;    // pos at the start of the tick, to interpolate rendering
+        std::vector<int> damage;
+        std::vector<uint8_t> fromEnemy;
+        std::vector<uint8_t> removed;
+        std::vector<size_t> pending;        // indices pending removal
+
+        size_t size() const { return x.size(); }
+        vector pos(size_t i) const { return { x[i], y[i] }; }
+        vector prevPos(size_t i) const { return { prevX[i], prevY[i] }; }
+        bool isRemoved(size_t i) const { return removed[i]; }
+
+        void add(vector pos, vector vel, int damage, bool fromEnemy);
+        void remove(size_t i);
+        void compact();
+        void clear();
+
+        // move every bullet one step and remove the ones leaving [minX, maxX],
+        // SSE2/AVX2 when the target has it, integrateScalar otherwise
+        void integrate(float deltaTime, float minX, float maxX);
+        void integrateScalar(float deltaTime, float minX, float maxX);
     };
 }
 
 // == Global vars
 // owned by main
 extern bool debug;
+extern bool headless;
 
 // owned by loader
 namespace Assets {
@@ -207,31 +416,33 @@ namespace Assets {
     extern std::vector<Faction> factions;
     extern std::vector<Font> fonts;
     extern std::vector<Background> backgrounds;
-    extern SDL_Texture *bulletTexture;
-    extern SDL_Texture *flagpoleTexture;
+    extern std::vector<AtlasPage> atlasPages;
+    extern Sprite bulletSprite;
+    extern Sprite flagpoleSprite;
+    extern Sprite missingSprite;
 
     extern SDL_Texture *missingTextureTexture;
     extern Mix_Chunk *missingSoundSound;
     extern Mix_Music *missingMusicMusic;
 
-    extern std::vector<Assets::Font>::iterator defaultFont;
+    extern FontId defaultFont;
 
     extern MusicTrack menuMusic;
 }
 
 // owned by game
 namespace Game {
-    extern std::vector<Assets::TerrainVariant>::iterator selectedTerrainVariant;
-    extern std::vector<Assets::Campaign>::iterator selectedCampaign;
-    extern std::vector<Assets::Map>::iterator selectedMap;
+    extern Assets::TerrainVariantId selectedTerrainVariant;
+    extern Assets::CampaignId selectedCampaign;
+    extern int selectedMap;     // index in the selected campaign's maps, -1 for none
 
-    extern std::vector<Assets::Faction>::iterator friendlyFaction, enemyFaction;
+    extern Assets::FactionId friendlyFaction, enemyFaction;
 
-    extern std::vector<Soldier> friendlies, enemies;
+    extern Pool<Soldier> friendlies, enemies;
     extern std::vector<MapPathPoint> friendlyMapPath, enemyMapPath;
     extern std::vector<MapPathPoint>::iterator friendlyObjective, enemyObjective;
 
-    extern std::vector<Bullet> bullets;
+    extern Bullets bullets;
 
     extern bool gameMode;
     extern int money;
@@ -241,11 +452,16 @@ namespace Game {
 
     extern int friendliesHoldingbjective;
     extern int enemiesHoldingObjective;
+
+    extern float tickRate;  // simulation ticks per second
+    extern long tick;       // ticks simulated since the map was set up
+    extern uint32_t matchSeed;  // every random draw of the match derives from it
 }
 
 // owned by renderer
 extern SDL_Window *window;
 extern SDL_Renderer *renderer;
+extern int maxFps;  // render frame rate cap, 0 for uncapped
 
 // == Global functions
 // Renderer
@@ -258,16 +474,156 @@ namespace Renderer {
 
 // Loader
 namespace Assets {
-    bool load(std::string assetsPath);
+    bool load(const std::vector<std::string>& assetPaths);    // index, and load what is always needed
+    // load what a map references on first use, free it when the last user releases it
+    void acquireMap(const Map& map);
+    void releaseMap(const Map& map);
+    void acquireBackground(Background& background);
+    void releaseBackground(Background& background);
+    // O(1) lookups by name, -1 when there is none
+    TerrainVariantId findTerrainVariant(const std::string& name);
+    CampaignId findCampaign(const std::string& name);
+    FactionId findFaction(const std::string& name);
+    CharacterId findCharacter(FactionId faction, const std::string& name);
+    BackgroundId findBackground(const std::string& name);
 }
 
 // Game
 namespace Game {
-    void soldierSpawn(const std::vector<Assets::Character>::iterator& character, bool enemy);
-    void soldierDeath(const std::vector<Game::Soldier>::iterator& soldier);
-    void soldierFire(const std::vector<Game::Soldier>::iterator& soldier);
+    Handle soldierSpawn(Assets::CharacterId character, bool enemy);
+    void soldierDeath(Game::Soldier& soldier);
+    void soldierFire(Game::Soldier& soldier);
+    void advance(bool enemy);
+    void seed(unsigned int seed);
     void mapSetup();
+    void mapTeardown();
     void update(float deltaTime);
+    void updateBullets(float deltaTime);
+    void updateAnimations(float deltaTime);
+}
+
+// Headless
+namespace Headless {
+    struct Options {
+        std::string campaign;   // campaign name, empty for the first one
+        int map;                // map index in the campaign
+        int ticks;              // simulation ticks to run
+        unsigned int seed;      // random seed
+        int soldiers;           // soldiers spawned per side in total
+        int spawnWave;          // soldiers spawned per side each wave
+        int spawnInterval;      // ticks between waves
+        int advanceInterval;    // ticks between orders to advance to the next trench
+        std::string bench;      // microbenchmark to run instead of a battle, empty for none
+    };
+
+    void initSDL();
+    void destroySDL();
+    int run(const Options& options);
+}
+
+// battle sound effects, shots are queued during the ticks and played once a
+// frame on a fixed number of voices, nearest first, busy samples as volleys.
+// Panned by screen position, shots further offscreen than cullDistance are dropped.
+namespace Audio {
+    extern float cullDistance;                  // px beyond the screen edges
+
+    void init();                                // after Mix_OpenAudio
+    void destroy();
+    void setViewport(float left, float width);  // visible world x range
+    void fire(Mix_Chunk *sound, vector pos);
+    void update();
+    void forget(Mix_Chunk *sound);              // before freeing a chunk that may be queued
+}
+
+// worker pool for the simulation, the calling thread works too
+namespace Jobs {
+    void init(int threads);     // total threads, 0 for one per core
+    void destroy();
+    int threadCount();
+    // run job(chunk) for every chunk in [0, chunks) and wait for all of them
+    void parallelFor(int chunks, const std::function<void(int)>& job);
+}
+
+// scoped timers, every thread records into its own ring buffer and dump()
+// writes what they hold as Chrome trace events (chrome://tracing, ui.perfetto.dev).
+// Off unless started, then a scope costs two clock reads.
+namespace Profiler {
+    extern bool enabled;
+
+    void start(const std::string& path);        // record, dump() writes to path
+    void dump();                                // call while the workers are idle
+    void setThreadName(const std::string& name);
+    uint64_t now();                             // ns since start
+    void record(const char *name, uint64_t begin, uint64_t end);
+
+    struct Scope {
+        const char *name;       // a literal, only the pointer is kept
+        uint64_t begin;
+
+        Scope(const char *name) : name(name), begin(enabled ? now() : 0) { }
+        ~Scope() { if (enabled) record(name, begin, now()); }
+    };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// single file asset bundle written by ww1game-pack and memory mapped by the loader
+// layout: Header, entry data (16 byte aligned), Entry table at indexOffset, names
+namespace Bundle {
+    constexpr char magic[8] = { 'W', 'W', '1', 'P', 'A', 'C', 'K', '\0' };
+    constexpr uint32_t version = 3;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint64_t indexOffset;
+    };
+
+    struct Entry {
+        enum Type : uint32_t { FILE, IMAGE, PROPERTIES, MAP };
+        uint64_t offset, size;
+        uint64_t hash;                      // hashBytes of the data, for dedup
+        uint32_t nameOffset, nameLength;    // in the name block after the table
+        uint32_t type;
+        uint32_t width, height;             // IMAGE: tightly packed RGBA32 pixels, MAP: tiles
+        uint32_t pad;
+    };
+
+    // PROPERTIES: a character's properties.cfg, parsed
+    struct Properties {
+        int32_t fireFrame;
+        float rpm;
+        int32_t roundDamage;
+        float muzzleVel;
+        float spread;
+        float marchSpeed;
+        float range;
+        int32_t iHealth;
+    };
+
+    // MAP: the five header lines of a .map, each NUL terminated, then the
+    // width * height tiles row by row
+    constexpr int mapHeaderLines = 5;
+
+    // properties.cfg lines in the order above, false if any is missing or not a number
+    bool parseProperties(const std::vector<std::string>& lines, Properties& properties);
+    void packMap(const Assets::Map& map, Entry& entry, std::vector<uint8_t>& data);
+    void unpackMap(const Entry *entry, const uint8_t *data, Assets::Map& map);
+
+    struct Reader {
+        const uint8_t *data = NULL;
+        size_t size = 0;
+        std::unordered_map<std::string, const Entry*> entries;             // by name relative to the asset root
+
+        const Entry* find(const std::string& name) const;
+        const uint8_t* contents(const Entry *entry) const { return data + entry->offset; }
+    };
+
+    bool open(const std::string& path, Reader& reader);
+    void close(Reader& reader);
 }
 
 // Inline util
@@ -275,6 +631,14 @@ inline void warning(const std::string& msg) {
     std::cout << "Warning: " << msg << std::endl;
 }
 
+// FNV-1a, to find assets with the same contents
+inline uint64_t hashBytes(const void *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+    return hash;
+}
+
 inline void exit_error(const std::string& msg) {
     std::cout << msg << std::endl;
     exit(1);
@@ -298,20 +662,22 @@ inline void error_img(const std::string& msg) {
     std::cout << msg << ": " << IMG_GetError() << std::endl;
 }
 
-inline std::vector<Assets::Faction>::iterator getFactionByName(std::string name) {
-    for (auto it = Assets::factions.begin(); it < Assets::factions.end(); it++)
-        if (it->name == name) return it;
-    return Assets::factions.end();
+inline Assets::TerrainVariant& getTerrainVariant(Assets::TerrainVariantId id) {
+    return Assets::terrainVariants[id];
+}
+
+inline Assets::Faction& getFaction(Assets::FactionId id) {
+    return Assets::factions[id];
+}
+
+inline Assets::Character& getCharacter(Assets::CharacterId id) {
+    return Assets::factions[id.faction].characters[id.character];
 }
 
-inline std::vector<Assets::Character>::iterator getCharacterByNameAndFaction(std::string name, std::vector<Assets::Faction>::iterator faction) {
-    for (auto it = faction->characters.begin(); it < faction->characters.end(); it++)
-        if (it->name == name) return it;
-    return faction->characters.end();
+inline Assets::Font& getFont(Assets::FontId id) {
+    return Assets::fonts[id];
 }
 
-inline auto getTerrainVariantByName(std::string name) {
-    for (auto it = Assets::terrainVariants.begin(); it < Assets::terrainVariants.end(); it++)
-        if (it->name == name) return it;
-    return Assets::terrainVariants.end();
+inline Assets::Map& getSelectedMap() {
+    return Assets::campaigns[Game::selectedCampaign].maps[Game::selectedMap];
 }
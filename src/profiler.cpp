@@ -0,0 +1,115 @@
+/*
+    ww1game:      Generic WW1 game (?)
+    profiler.cpp: Scoped timers and Chrome trace export
+
+    Copyright (C) 2022 Ángel Ruiz Fernandez
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "main.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace Profiler {
+    bool enabled = false;
+}
+
+// events kept per thread, the oldest are overwritten
+constexpr size_t profileCapacity = 1 << 16;
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t begin, end;
+};
+
+struct ProfileBuffer {
+    std::string threadName;
+    int tid;
+    std::vector<ProfileEvent> events;
+    uint64_t written = 0;
+};
+
+std::string profilePath;
+std::chrono::steady_clock::time_point profileStart;
+
+// buffers outlive their threads, only registering one takes the lock
+std::mutex profileMutex;
+std::vector<std::unique_ptr<ProfileBuffer>> profileBuffers;
+thread_local ProfileBuffer *threadBuffer = NULL;
+thread_local std::string threadName = "main";
+
+void Profiler::start(const std::string& path) {
+    profilePath = path;
+    profileStart = std::chrono::steady_clock::now();
+    enabled = true;
+}
+
+uint64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileStart).count();
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    threadName = name;
+    if (threadBuffer) threadBuffer->threadName = name;
+}
+
+void Profiler::record(const char *name, uint64_t begin, uint64_t end) {
+    if (threadBuffer == NULL) {
+        std::lock_guard<std::mutex> lock(profileMutex);
+        profileBuffers.push_back(std::make_unique<ProfileBuffer>());
+        threadBuffer = profileBuffers.back().get();
+        threadBuffer->threadName = threadName;
+        threadBuffer->tid = profileBuffers.size();
+        threadBuffer->events.resize(profileCapacity);
+    }
+    threadBuffer->events[threadBuffer->written++ % profileCapacity] = { name, begin, end };
+}
+
+void Profiler::dump() {
+    if (!enabled) return;
+
+    std::ofstream out(profilePath, std::ios::trunc);
+    if (!out.is_open()) {
+        warning("Could not open " + profilePath + " for writing the profile");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(profileMutex);
+    size_t events = 0;
+    out << "{\"traceEvents\":[" << std::endl;
+    bool first = true;
+    for (const auto& buffer : profileBuffers) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+        first = false;
+
+        // oldest first
+        uint64_t count = std::min<uint64_t>(buffer->written, profileCapacity);
+        for (uint64_t i = buffer->written - count; i < buffer->written; i++) {
+            const ProfileEvent& event = buffer->events[i % profileCapacity];
+            out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << event.begin / 1000 << "." << (event.begin % 1000) / 100
+                << ",\"dur\":" << (event.end - event.begin) / 1000 << "." << ((event.end - event.begin) % 1000) / 100 << "}";
+        }
+        events += count;
+    }
+    out << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+
+    if (!out) warning("Error writing the profile to " + profilePath);
+    else std::cout << "Wrote " << events << " profile events to " << profilePath << std::endl;
+}
@@ -21,7 +21,10 @@
 #include "main.hpp"
 
 #include <iostream>
+#include <cstdio>
 #include <chrono>
+#include <algorithm>
+#include <unordered_map>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
@@ -29,44 +32,200 @@
 #include <SDL2/SDL_mixer.h>
 
 // util functions
-SDL_Texture* getMapTexture(char c) {
-    for (Assets::Tile& tx : Game::selectedTerrainVariant->terrainTextures)
-        if (tx.name[0] == c) return tx.texture;
-    return Assets::missingTextureTexture;
+int drawCalls = 0;      // SDL draw calls this frame, for the performance panel
+
+const Assets::Sprite& getMapTexture(const Assets::TerrainVariant& variant, char c) {
+    int16_t tile = variant.tileIndex[(uint8_t)c];
+    return tile < 0 ? Assets::missingSprite : variant.terrainTextures[tile].sprite;
 }
 
 void renderTexture(SDL_Texture *t, int w, int h, int x, int y, bool mirror = false) {
     SDL_Rect rect;
     rect.h = h; rect.w = w; rect.x = x; rect.y = y;
     SDL_RendererFlip flip = mirror ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
+    drawCalls++;
     SDL_RenderCopyEx(renderer, t, NULL, &rect, 0.0, NULL, flip);
 }
 
+// draw a region of an atlas page, consecutive draws from one page get batched by SDL
+void renderSprite(const Assets::Sprite& s, int w, int h, int x, int y, bool mirror = false) {
+    if (s.page < 0 || Assets::atlasPages[s.page].texture == NULL) return;
+    SDL_Rect rect;
+    rect.h = h; rect.w = w; rect.x = x; rect.y = y;
+    SDL_RendererFlip flip = mirror ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
+    drawCalls++;
+    SDL_RenderCopyEx(renderer, Assets::atlasPages[s.page].texture, &s.rect, &rect, 0.0, NULL, flip);
+}
+
+// sprite batch, consecutive quads from one atlas page go out in one
+// SDL_RenderGeometry call, so a battle costs a few draw calls instead of one per
+// sprite. A quad from another page flushes first, draws keep the order they were
+// submitted in and later sprites stay on top
+struct SpriteBatch {
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+};
+
+SpriteBatch spriteBatch;
+int spriteBatchPage = -1;
+SDL_BlendMode spriteBatchBlendMode = SDL_BLENDMODE_BLEND;
+
+void flushSprites() {
+    if (spriteBatch.indices.empty()) return;
+    SDL_Texture *texture = Assets::atlasPages[spriteBatchPage].texture;
+    if (spriteBatchBlendMode != SDL_BLENDMODE_BLEND) SDL_SetTextureBlendMode(texture, spriteBatchBlendMode);
+    drawCalls++;
+    if (SDL_RenderGeometry(renderer, texture, spriteBatch.vertices.data(), spriteBatch.vertices.size(), spriteBatch.indices.data(), spriteBatch.indices.size()) < 0)
+        error_sdl("SDL_RenderGeometry failed");
+    if (spriteBatchBlendMode != SDL_BLENDMODE_BLEND) SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    spriteBatch.vertices.clear();
+    spriteBatch.indices.clear();
+}
+
+// pages blend by default, SDL_BLENDMODE_NONE copies the pixels as they are
+void batchSprite(const Assets::Sprite& s, float w, float h, float x, float y, bool mirror = false, SDL_BlendMode blendMode = SDL_BLENDMODE_BLEND) {
+    if (s.page < 0) return;
+    const Assets::AtlasPage& page = Assets::atlasPages[s.page];
+    if (page.texture == NULL) return;
+    if (s.page != spriteBatchPage || blendMode != spriteBatchBlendMode) {
+        flushSprites();
+        spriteBatchPage = s.page;
+        spriteBatchBlendMode = blendMode;
+    }
+
+    float invWidth = 1.0f / page.width, invHeight = 1.0f / page.height;
+    float u0 = s.rect.x * invWidth, u1 = (s.rect.x + s.rect.w) * invWidth;
+    float v0 = s.rect.y * invHeight, v1 = (s.rect.y + s.rect.h) * invHeight;
+    if (mirror) std::swap(u0, u1);     // horizontal flip by swapping the texcoords
+
+    SDL_Color white = { 255, 255, 255, 255 };
+    int base = spriteBatch.vertices.size();
+    spriteBatch.vertices.push_back({ { x, y }, white, { u0, v0 } });
+    spriteBatch.vertices.push_back({ { x + w, y }, white, { u1, v0 } });
+    spriteBatch.vertices.push_back({ { x + w, y + h }, white, { u1, v1 } });
+    spriteBatch.vertices.push_back({ { x, y + h }, white, { u0, v1 } });
+    for (int i : { 0, 1, 2, 2, 3, 0 }) spriteBatch.indices.push_back(base + i);
+}
+
 #define TEXT_CENTERX    (unsigned int)1
 #define TEXT_CENTERY    (unsigned int)2
 
-int renderText(std::string str, TTF_Font* font, int x, int y, unsigned int flags, SDL_Color color) {
-    SDL_Surface* surfaceText = TTF_RenderText_Blended(font, str.c_str(), color);
-    SDL_Texture* textureText = SDL_CreateTextureFromSurface(renderer, surfaceText);
+// printable ascii of each font is rasterized once, white, into one texture,
+// text is then drawn as quads tinted by the vertex color. Strings with anything
+// else are rasterized whole by renderTextUTF8
+struct GlyphAtlas {
+    struct Glyph { SDL_Rect rect; int advance; };
+    SDL_Texture *texture = NULL;
+    int width = 0, height = 0;
+    Glyph glyphs[128];
+};
+
+std::unordered_map<TTF_Font*, GlyphAtlas> glyphAtlases;
+std::vector<SDL_Vertex> textVertices;
+std::vector<int> textIndices;
+
+GlyphAtlas& getGlyphAtlas(TTF_Font *font) {
+    auto it = glyphAtlases.find(font);
+    if (it != glyphAtlases.end()) return it->second;
+
+    GlyphAtlas& atlas = glyphAtlases[font];
+    SDL_Color white = { 255, 255, 255, 255 };
+
+    SDL_Surface *glyphSurfaces[128] = { NULL };
+    atlas.height = TTF_FontHeight(font);
+    for (int c = 32; c < 127; c++) {
+        int advance = 0;
+        TTF_GlyphMetrics(font, c, NULL, NULL, NULL, NULL, &advance);
+        atlas.glyphs[c].advance = advance;
+        if ((glyphSurfaces[c] = TTF_RenderGlyph_Blended(font, c, white)) == NULL) continue;
+        atlas.glyphs[c].rect = { atlas.width, 0, glyphSurfaces[c]->w, glyphSurfaces[c]->h };
+        atlas.width += glyphSurfaces[c]->w + 1;
+        atlas.height = std::max(atlas.height, glyphSurfaces[c]->h);
+    }
 
-    SDL_Rect rectText;  // create a rect
-    rectText.x = x;     // controls the rect's x coordinate 
-    rectText.y = y;     // controls the rect's y coordinte
-    rectText.w = 0;     // controls the width of the rect
-    rectText.h = 0;     // controls the height of the rect
+    SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0, std::max(atlas.width, 1), atlas.height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (surf == NULL) exit_error_sdl("SDL_CreateRGBSurfaceWithFormat failed on glyph atlas");
+    for (int c = 32; c < 127; c++) {
+        if (glyphSurfaces[c] == NULL) continue;
+        SDL_Rect dst = atlas.glyphs[c].rect;
+        SDL_SetSurfaceBlendMode(glyphSurfaces[c], SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(glyphSurfaces[c], NULL, surf, &dst);
+        SDL_FreeSurface(glyphSurfaces[c]);
+    }
+
+    if ((atlas.texture = SDL_CreateTextureFromSurface(renderer, surf)) == NULL)
+        error_sdl("SDL_CreateTextureFromSurface failed on glyph atlas");
+    SDL_SetTextureBlendMode(atlas.texture, SDL_BLENDMODE_BLEND);
+    SDL_FreeSurface(surf);
+    return atlas;
+}
 
-    TTF_SizeText(font, str.c_str(), &rectText.w, &rectText.h);
+void destroyGlyphAtlases() {
+    for (auto& [font, atlas] : glyphAtlases)
+        if (atlas.texture) SDL_DestroyTexture(atlas.texture);
+    glyphAtlases.clear();
+}
 
+// text outside the atlas, rasterized whole every call like before the atlas
+int renderTextUTF8(const std::string& str, TTF_Font* font, int x, int y, unsigned int flags, SDL_Color color) {
+    SDL_Surface* surfaceText = TTF_RenderUTF8_Blended(font, str.c_str(), color);
+    if (surfaceText == NULL) return -1;
+    SDL_Texture* textureText = SDL_CreateTextureFromSurface(renderer, surfaceText);
+    SDL_FreeSurface(surfaceText);
+    if (textureText == NULL) return -1;
+
+    SDL_Rect rectText = { x, y, 0, 0 };
+    TTF_SizeUTF8(font, str.c_str(), &rectText.w, &rectText.h);
     if (flags & TEXT_CENTERX) rectText.x -= rectText.w / 2;
     if (flags & TEXT_CENTERY) rectText.y -= rectText.h / 2;
 
-    SDL_RenderCopy(renderer, textureText, nullptr, &rectText);
-
-    // I had to run valgrind to find this, I'm such a terrible programmer
-    SDL_FreeSurface(surfaceText);
+    drawCalls++;
+    int result = SDL_RenderCopy(renderer, textureText, nullptr, &rectText);
     SDL_DestroyTexture(textureText);
+    return result;
+}
+
+int renderText(const std::string& str, TTF_Font* font, int x, int y, unsigned int flags, SDL_Color color) {
+    // accents, other scripts and control characters aren't in the atlas
+    for (char c : str)
+        if (c < 32 || c > 126) return renderTextUTF8(str, font, x, y, flags, color);
+
+    GlyphAtlas& atlas = getGlyphAtlas(font);
+    if (atlas.texture == NULL) return -1;
+
+    // kerning pairs as TTF_RenderText applies them
+    auto kerning = [&](size_t i) {
+        return i > 0 ? TTF_GetFontKerningSizeGlyphs(font, (uint8_t)str[i - 1], (uint8_t)str[i]) : 0;
+    };
+
+    int width = 0;
+    for (size_t i = 0; i < str.size(); i++) width += kerning(i) + atlas.glyphs[(int)str[i]].advance;
+
+    if (flags & TEXT_CENTERX) x -= width / 2;
+    if (flags & TEXT_CENTERY) y -= atlas.height / 2;
+
+    float invWidth = 1.0f / atlas.width, invHeight = 1.0f / atlas.height;
+    textVertices.clear();
+    textIndices.clear();
+    for (size_t i = 0; i < str.size(); i++) {
+        const GlyphAtlas::Glyph& g = atlas.glyphs[(int)str[i]];
+        x += kerning(i);
+        float u0 = g.rect.x * invWidth, u1 = (g.rect.x + g.rect.w) * invWidth;
+        float v0 = g.rect.y * invHeight, v1 = (g.rect.y + g.rect.h) * invHeight;
+        float x0 = x, y0 = y, x1 = x + g.rect.w, y1 = y + g.rect.h;
+
+        int base = textVertices.size();
+        textVertices.push_back({ { x0, y0 }, color, { u0, v0 } });
+        textVertices.push_back({ { x1, y0 }, color, { u1, v0 } });
+        textVertices.push_back({ { x1, y1 }, color, { u1, v1 } });
+        textVertices.push_back({ { x0, y1 }, color, { u0, v1 } });
+        for (int i : { 0, 1, 2, 2, 3, 0 }) textIndices.push_back(base + i);
+        x += g.advance;
+    }
 
-    return 0;
+    if (textIndices.empty()) return 0;
+    drawCalls++;
+    return SDL_RenderGeometry(renderer, atlas.texture, textVertices.data(), textVertices.size(), textIndices.data(), textIndices.size());
 }
 
 void setColor(SDL_Color c) {
@@ -86,7 +245,7 @@ SDL_Renderer *renderer = NULL;
 #define C_A      {224, 201, 166, 255}
 
 namespace Assets {
-    std::vector<Assets::Font>::iterator defaultFont;
+    FontId defaultFont = -1;
 
     SDL_Texture *missingTextureTexture;
     Mix_Chunk *missingSoundSound;
@@ -94,35 +253,75 @@ namespace Assets {
 }
 
 // local stuff
-#define ANIM_FPS    7
-
 bool run = true;
 
 float fps = 0.0f;
 auto time_prev = std::chrono::high_resolution_clock::now();
-long frameCounter = 0;
-int anim_div = 0;
+float tickAccumulator = 0.0f;
 bool inMenu = true;
 
+int maxFps = 0;
+
 int screenWidth = 1280;
 int screenHeight = 720;
 
 int worldOrgX = 0, worldOrgY = 0;
 
 void renderBackground() {
-    for (const Assets::Background& background : Assets::backgrounds) {
-        if (background.name == Game::selectedMap->backgroundName) {
-            setColor(background.skyColor);
-            SDL_RenderClear(renderer);
-            float factor = float(screenWidth) / float(background.width);
-            renderTexture(background.texture, factor * background.width, factor * background.height, 0, (worldOrgY + Game::friendlyMapPath[0].pos.y) - (factor * background.height), false);
-            return;
-        }
+    if (getSelectedMap().background >= 0) {
+        const Assets::Background& background = Assets::backgrounds[getSelectedMap().background];
+        setColor(background.skyColor);
+        SDL_RenderClear(renderer);
+        float factor = float(screenWidth) / float(background.width);
+        renderTexture(background.texture, factor * background.width, factor * background.height, 0, (worldOrgY + Game::friendlyMapPath[0].pos.y) - (factor * background.height), false);
+        return;
     }
 
     renderTexture(Assets::missingTextureTexture, screenWidth, screenHeight - (Game::friendlyMapPath[0].pos.y), 0, 0, false);
 }
 
+// the static terrain is baked after map setup into render targets a few
+// columns wide, and only the chunks on screen get drawn
+constexpr int terrainChunkColumns = 32;
+std::vector<SDL_Texture*> terrainChunks;
+
+void destroyTerrain() {
+    for (SDL_Texture *chunk : terrainChunks) SDL_DestroyTexture(chunk);
+    terrainChunks.clear();
+}
+
+void bakeTerrain() {
+    destroyTerrain();
+    if (Game::selectedTerrainVariant < 0) return;
+    const Assets::TerrainVariant& variant = getTerrainVariant(Game::selectedTerrainVariant);
+    const Assets::Map& map = getSelectedMap();
+
+    int chunks = (map.width + terrainChunkColumns - 1) / terrainChunkColumns;
+    for (int c = 0; c < chunks; c++) {
+        SDL_Texture *chunk = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+            terrainChunkColumns * TILE_SIZE, map.height * TILE_SIZE);
+        if (chunk == NULL) exit_error_sdl("SDL_CreateTexture failed on terrain chunk");
+        SDL_SetTextureBlendMode(chunk, SDL_BLENDMODE_BLEND);
+        terrainChunks.push_back(chunk);
+
+        SDL_SetRenderTarget(renderer, chunk);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderClear(renderer);
+
+        for (int y = 0; y < map.height; y++) {
+            for (int x = c * terrainChunkColumns; x < std::min((c + 1) * terrainChunkColumns, map.width); x++) {
+                if (map.map[y][x] == ' ') continue;
+                batchSprite(getMapTexture(variant, map.map[y][x]), TILE_SIZE, TILE_SIZE, TILE_SIZE * (x - c * terrainChunkColumns), TILE_SIZE * y, false,
+                    SDL_BLENDMODE_NONE);
+            }
+        }
+        // tiles don't overlap, copying them keeps their alpha for the one blend when the chunk is drawn
+        flushSprites();
+    }
+
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
 int menuBgIdx = 0;
 
 void renderMenuBackground() {
@@ -134,89 +333,99 @@ void renderMenuBackground() {
 }
 
 void renderMap() {
-    for (int y = 0; y < Game::selectedMap->height; y++) {
-        for (int x = 0; x < Game::selectedMap->width; x++) {
-            if (Game::selectedMap->map[y][x] == ' ') continue;
-            renderTexture(getMapTexture(Game::selectedMap->map[y][x]), TILE_SIZE, TILE_SIZE, worldOrgX + (TILE_SIZE * x), worldOrgY + (TILE_SIZE * y), false);
-        }
-    }
+    PROFILE_SCOPE("renderMap");
+    int chunkWidth = terrainChunkColumns * TILE_SIZE;
+    int first = std::max(0, -worldOrgX / chunkWidth);
+    int last = std::min(int(terrainChunks.size()) - 1, (screenWidth - worldOrgX) / chunkWidth);
+    for (int c = first; c <= last; c++)
+        renderTexture(terrainChunks[c], chunkWidth, getSelectedMap().height * TILE_SIZE, worldOrgX + c * chunkWidth, worldOrgY);
 
     // render flags
     for (int i = 0; i < Game::friendlyMapPath.size(); i++) {
         if (Game::friendlyMapPath[i].type == Game::MapPathPoint::TRENCH && Game::friendlyMapPath[i].action == Game::MapPathPoint::MARCH) {
-            renderTexture(Assets::flagpoleTexture, TILE_SIZE, 3 * TILE_SIZE, worldOrgX + Game::friendlyMapPath[i].pos.x - (TILE_SIZE / 2), worldOrgY + Game::friendlyMapPath[i].pos.y - (3 * TILE_SIZE));
-            renderTexture(Game::friendlyFaction->flag, 2 * TILE_SIZE, Game::friendlyFaction->flagHeight, worldOrgX + Game::friendlyMapPath[i].pos.x, worldOrgY + Game::friendlyMapPath[i].pos.y - (3 * TILE_SIZE));
+            batchSprite(Assets::flagpoleSprite, TILE_SIZE, 3 * TILE_SIZE, worldOrgX + Game::friendlyMapPath[i].pos.x - (TILE_SIZE / 2), worldOrgY + Game::friendlyMapPath[i].pos.y - (3 * TILE_SIZE));
+            batchSprite(getFaction(Game::friendlyFaction).flag, 2 * TILE_SIZE, getFaction(Game::friendlyFaction).flagHeight, worldOrgX + Game::friendlyMapPath[i].pos.x, worldOrgY + Game::friendlyMapPath[i].pos.y - (3 * TILE_SIZE));
         }
     }
     for (int i = 0; i < Game::enemyMapPath.size(); i++) {
         if (Game::enemyMapPath[i].type == Game::MapPathPoint::TRENCH && Game::enemyMapPath[i].action == Game::MapPathPoint::MARCH) {
-            renderTexture(Assets::flagpoleTexture, TILE_SIZE, 3 * TILE_SIZE, worldOrgX + Game::enemyMapPath[i].pos.x - (TILE_SIZE / 2), worldOrgY + Game::enemyMapPath[i].pos.y - (3 * TILE_SIZE));
-            renderTexture(Game::enemyFaction->flag, 2 * TILE_SIZE, Game::enemyFaction->flagHeight, worldOrgX + Game::enemyMapPath[i].pos.x, worldOrgY + Game::enemyMapPath[i].pos.y - (3 * TILE_SIZE));
+            batchSprite(Assets::flagpoleSprite, TILE_SIZE, 3 * TILE_SIZE, worldOrgX + Game::enemyMapPath[i].pos.x - (TILE_SIZE / 2), worldOrgY + Game::enemyMapPath[i].pos.y - (3 * TILE_SIZE));
+            batchSprite(getFaction(Game::enemyFaction).flag, 2 * TILE_SIZE, getFaction(Game::enemyFaction).flagHeight, worldOrgX + Game::enemyMapPath[i].pos.x, worldOrgY + Game::enemyMapPath[i].pos.y - (3 * TILE_SIZE));
         }
     }
+    flushSprites();
 
     if (debug) {
         for (int i = 0; i < Game::friendlyMapPath.size() - 1; i++) {
             if (Game::friendlyMapPath[i].type == Game::MapPathPoint::GROUND) setColor(C_RED);
             else setColor(C_YELLOW);
+            drawCalls++;
             SDL_RenderDrawLineF(renderer, worldOrgX + Game::friendlyMapPath[i].pos.x, worldOrgY + Game::friendlyMapPath[i].pos.y, worldOrgX + Game::friendlyMapPath[i + 1].pos.x, worldOrgY + Game::friendlyMapPath[i + 1].pos.y);
         }
 
         for (int i = 0; i < Game::enemyMapPath.size() - 1; i++) {
             if (Game::enemyMapPath[i].type == Game::MapPathPoint::GROUND) setColor(C_RED);
             else setColor(C_YELLOW);
+            drawCalls++;
             SDL_RenderDrawLineF(renderer, worldOrgX + Game::enemyMapPath[i].pos.x, worldOrgY + Game::enemyMapPath[i].pos.y, worldOrgX + Game::enemyMapPath[i + 1].pos.x, worldOrgY + Game::enemyMapPath[i + 1].pos.y);
         }
 
         setColor(C_RED);
+        drawCalls++;
         SDL_RenderDrawLineF(renderer, worldOrgX + Game::enemyObjective->pos.x, worldOrgY + Game::enemyObjective->pos.y, worldOrgX + Game::enemyObjective->pos.x, worldOrgY + Game::enemyObjective->pos.y - 100);
         setColor(C_GREEN);
+        drawCalls++;
         SDL_RenderDrawLineF(renderer, worldOrgX + Game::friendlyObjective->pos.x, worldOrgY + Game::friendlyObjective->pos.y, worldOrgX + Game::friendlyObjective->pos.x, worldOrgY + Game::friendlyObjective->pos.y - 100);
     }
 }
 
-void renderBullets() {
-    for (const Game::Bullet& bullet : Game::bullets)
-        renderTexture(Assets::bulletTexture, 32, 32, worldOrgX + bullet.pos.x, worldOrgY + bullet.pos.y, false);
+void renderBullets(float alpha) {
+    PROFILE_SCOPE("renderBullets");
+    for (size_t i = 0; i < Game::bullets.size(); i++) {
+        vector pos = lerp(Game::bullets.prevPos(i), Game::bullets.pos(i), alpha);
+        batchSprite(Assets::bulletSprite, 32, 32, worldOrgX + pos.x, worldOrgY + pos.y, false);
+    }
+    flushSprites();
 }
 
-void renderSoldiers(std::vector<Game::Soldier>& soldiers, bool enemy) {
-    for (Game::Soldier& soldier : soldiers) {
+void renderSoldiers(const Pool<Game::Soldier>& soldiers, bool enemy, float alpha) {
+    PROFILE_SCOPE("renderSoldiers");
+    for (const Game::Soldier& soldier : soldiers) {
+        const Assets::Character& character = getCharacter(soldier.character);
+        vector pos = lerp(soldier.prevPos, soldier.pos, alpha);
         switch (soldier.state) {
             case Game::Soldier::FIRING: {
-                if (soldier.frameCounter >= soldier.character->fire.size()) { soldier.state = soldier.prevState; soldier.frameCounter = 0;
-                    renderTexture(soldier.character->idle, soldier.character->size.x, soldier.character->size.y, worldOrgX + soldier.pos.x, worldOrgY + soldier.pos.y, enemy);
+                if (soldier.frameCounter >= character.fire.size()) {
+                    batchSprite(character.idle, character.size.x, character.size.y, worldOrgX + pos.x, worldOrgY + pos.y, enemy);
                     continue; }
-                renderTexture(soldier.character->fire[soldier.frameCounter], soldier.character->size.x, soldier.character->size.y, worldOrgX + soldier.pos.x, worldOrgY + soldier.pos.y, enemy);
-                if (frameCounter == 0) { soldier.frameCounter++; }
+                batchSprite(character.fire[soldier.frameCounter], character.size.x, character.size.y, worldOrgX + pos.x, worldOrgY + pos.y, enemy);
             } break;
             case Game::Soldier::SoldierState::DYING: {
-                if (soldier.frameCounter >= soldier.character->death.size()) break;
-                renderTexture(soldier.character->death[soldier.frameCounter], soldier.character->size.x, soldier.character->size.y, worldOrgX + soldier.pos.x, worldOrgY + soldier.pos.y, enemy);
-                if (frameCounter == 0) { soldier.frameCounter++; }
+                if (soldier.frameCounter >= character.death.size()) break;
+                batchSprite(character.death[soldier.frameCounter], character.size.x, character.size.y, worldOrgX + pos.x, worldOrgY + pos.y, enemy);
             } break;
             case Game::Soldier::SoldierState::IDLE: {
-                renderTexture(soldier.character->idle, soldier.character->size.x, soldier.character->size.y, worldOrgX + soldier.pos.x, worldOrgY + soldier.pos.y, enemy);
+                batchSprite(character.idle, character.size.x, character.size.y, worldOrgX + pos.x, worldOrgY + pos.y, enemy);
             } break;
             case Game::Soldier::SoldierState::MARCHING: {
-                if (soldier.frameCounter >= soldier.character->march.size()) soldier.frameCounter = 0;
-                renderTexture(soldier.character->march[soldier.frameCounter], soldier.character->size.x, soldier.character->size.y, worldOrgX + soldier.pos.x, worldOrgY + soldier.pos.y, enemy);
-                if (frameCounter == 0) { soldier.frameCounter++; }
+                if (soldier.frameCounter >= character.march.size()) break;
+                batchSprite(character.march[soldier.frameCounter], character.size.x, character.size.y, worldOrgX + pos.x, worldOrgY + pos.y, enemy);
             } break;
         }
     }
+    flushSprites();
 }
 
 void menuKeyHandler(SDL_Keycode key) {
     if (key >= SDLK_0 && key <= SDLK_9) {
         int itemIdx = key - SDLK_0;
-        if (Game::selectedCampaign == Assets::campaigns.end()) {
+        if (Game::selectedCampaign < 0) {
             if (itemIdx < Assets::campaigns.size())
-                Game::selectedCampaign = Assets::campaigns.begin() + itemIdx;
-                Game::selectedMap = Game::selectedCampaign->maps.end();
+                Game::selectedCampaign = itemIdx;
+            Game::selectedMap = -1;
         } else {
-            if (itemIdx < Game::selectedCampaign->maps.size())
-                Game::selectedMap = Game::selectedCampaign->maps.begin() + itemIdx;
+            if (itemIdx < Assets::campaigns[Game::selectedCampaign].maps.size())
+                Game::selectedMap = itemIdx;
         }
     }
 }
@@ -226,7 +435,7 @@ void renderMenu() {
     //SDL_RenderClear(renderer);
     renderMenuBackground();
 
-    renderText("ww1game: arf20's arcade-ish 2D WW1 game (?)", Assets::defaultFont->font20, screenWidth / 2, 50, TEXT_CENTERX, C_BLACK);
+    renderText("ww1game: arf20's arcade-ish 2D WW1 game (?)", getFont(Assets::defaultFont).font20, screenWidth / 2, 50, TEXT_CENTERX, C_BLACK);
 
     SDL_Rect button;
     button.w = 400;
@@ -234,49 +443,55 @@ void renderMenu() {
     button.x = (screenWidth / 2) - 200;
     setColor(C_A);
 
-    if (Game::selectedCampaign == Assets::campaigns.end())
+    if (Game::selectedCampaign < 0)
         for (int i = 0; i < Assets::campaigns.size(); i++) {
             button.y = 100 + (i * 60);
+            drawCalls++;
             SDL_RenderFillRect(renderer, &button);
-            renderText(std::to_string(i) + ". " + Assets::campaigns[i].nameNice, Assets::defaultFont->font20, screenWidth / 2, 120 + (i * 60), TEXT_CENTERX | TEXT_CENTERY, C_BLACK);
+            renderText(std::to_string(i) + ". " + Assets::campaigns[i].nameNice, getFont(Assets::defaultFont).font20, screenWidth / 2, 120 + (i * 60), TEXT_CENTERX | TEXT_CENTERY, C_BLACK);
         }
     else
-        for (int i = 0; i < Game::selectedCampaign->maps.size(); i++) {
+        for (int i = 0; i < Assets::campaigns[Game::selectedCampaign].maps.size(); i++) {
             button.y = 100 + (i * 60);
+            drawCalls++;
             SDL_RenderFillRect(renderer, &button);
-            renderText(std::to_string(i) + ". " + Game::selectedCampaign->maps[i].name, Assets::defaultFont->font20, screenWidth / 2, 120 + (i * 60), TEXT_CENTERX | TEXT_CENTERY, C_BLACK);
+            renderText(std::to_string(i) + ". " + Assets::campaigns[Game::selectedCampaign].maps[i].name, getFont(Assets::defaultFont).font20, screenWidth / 2, 120 + (i * 60), TEXT_CENTERX | TEXT_CENTERY, C_BLACK);
         }
 
-    if (Game::selectedCampaign != Assets::campaigns.end())
-        if (Game::selectedMap != Game::selectedCampaign->maps.end()) {
+    if (Game::selectedCampaign >= 0)
+        if (Game::selectedMap >= 0) {
             inMenu = false;
             Game::mapSetup();
+            bakeTerrain();
         }
 }
 
 void renderHud() {
+    PROFILE_SCOPE("renderHud");
     // Render soldiers
     SDL_Rect button;
     setColor(C_A);
 
-    for (int i = 0; i < Game::friendlyFaction->characters.size(); i++) {
-        auto& c = Game::friendlyFaction->characters[i];
+    for (int i = 0; i < getFaction(Game::friendlyFaction).characters.size(); i++) {
+        auto& c = getFaction(Game::friendlyFaction).characters[i];
         button.w = c.size.x; button.h = c.size.y;
         button.x = 10 + ((10 + c.size.x) * i); button.y = screenHeight - (10 + c.size.y);
+        drawCalls++;
         SDL_RenderFillRect(renderer, &button);
-        renderText(c.nameNice, Assets::defaultFont->font12, button.x + button.w / 2, button.y, TEXT_CENTERX, C_BLACK);
-        renderTexture(c.idle, c.size.x, c.size.y, button.x, button.y);
+        renderText(c.nameNice, getFont(Assets::defaultFont).font12, button.x + button.w / 2, button.y, TEXT_CENTERX, C_BLACK);
+        renderSprite(c.idle, c.size.x, c.size.y, button.x, button.y);
     }
 
     if (Game::gameMode) {
-        int orgx = screenWidth - ((10 + Game::enemyFaction->characters[0].size.x) * Game::enemyFaction->characters.size());
-        for (int i = 0; i < Game::enemyFaction->characters.size(); i++) {
-            auto& c = Game::enemyFaction->characters[i];
+        int orgx = screenWidth - ((10 + getFaction(Game::enemyFaction).characters[0].size.x) * getFaction(Game::enemyFaction).characters.size());
+        for (int i = 0; i < getFaction(Game::enemyFaction).characters.size(); i++) {
+            auto& c = getFaction(Game::enemyFaction).characters[i];
             button.w = c.size.x; button.h = c.size.y;
             button.x = orgx + ((10 + c.size.x) * i); button.y = screenHeight - (10 + c.size.y);
+            drawCalls++;
             SDL_RenderFillRect(renderer, &button);
-            renderText(c.nameNice, Assets::defaultFont->font12, button.x + button.w / 2, button.y, TEXT_CENTERX, C_BLACK);
-            renderTexture(c.idle, c.size.x, c.size.y, button.x, button.y);
+            renderText(c.nameNice, getFont(Assets::defaultFont).font12, button.x + button.w / 2, button.y, TEXT_CENTERX, C_BLACK);
+            renderSprite(c.idle, c.size.x, c.size.y, button.x, button.y);
         }
     }
 }
@@ -293,86 +508,182 @@ void gameKeyHandler(SDL_Keycode key) {
             worldOrgX -= 10;
         } break;
         case SDLK_q: {
-            for (int i = 0; i < Game::friendlyMapPath.size(); i++) {
-                auto& p = Game::friendlyMapPath[i];
-                if (p.action == Game::MapPathPoint::HOLD) {
-                    if (Game::friendlyObjective != (Game::friendlyMapPath.begin() + i))
-                        p.action = Game::MapPathPoint::MARCH;
-                    break;
-                }
-            }
+            Game::advance(false);
         } break;
         case SDLK_e: {
-            for (int i = Game::enemyMapPath.size() - 1; i >= 0; i--) {
-                auto& p = Game::enemyMapPath[i];
-                if (p.action == Game::MapPathPoint::HOLD) {
-                    if (Game::enemyObjective != (Game::enemyMapPath.begin() + i))
-                        p.action = Game::MapPathPoint::MARCH;
-                    break;
-                }
-            }
+            Game::advance(true);
+        } break;
+        case SDLK_p: {
+            Profiler::dump();
         } break;
     }
 
     // keys 1-5 spawn friendlies
     if (key >= SDLK_1 && key <= SDLK_5)
-        if (key - SDLK_1 < Game::friendlyFaction->characters.size())
-            Game::soldierSpawn(Game::friendlyFaction->characters.begin() + (key - SDLK_1), false);
+        if (key - SDLK_1 < getFaction(Game::friendlyFaction).characters.size())
+            Game::soldierSpawn(Assets::CharacterId { Game::friendlyFaction, int16_t(key - SDLK_1) }, false);
     
     // keys 6-0 (top keyb numerical row) enemies
     if (key >= SDLK_6 && key <= SDLK_9)
-        if (5 - (key - SDLK_6 + 1) < Game::enemyFaction->characters.size())
-            Game::soldierSpawn(Game::enemyFaction->characters.begin() + 5 - (key - SDLK_6 + 1), true);
+        if (5 - (key - SDLK_6 + 1) < getFaction(Game::enemyFaction).characters.size())
+            Game::soldierSpawn(Assets::CharacterId { Game::enemyFaction, int16_t(5 - (key - SDLK_6 + 1)) }, true);
 
     if (key == SDLK_0)
-        if (Game::enemyFaction->characters.size() > 0)
-            Game::soldierSpawn(Game::enemyFaction->characters.begin(), true);
+        if (getFaction(Game::enemyFaction).characters.size() > 0)
+            Game::soldierSpawn({ Game::enemyFaction, 0 }, true);
 }
 
 void Renderer::setup() {
     menuBgIdx = std::rand() % Assets::backgrounds.size();
+    Assets::acquireBackground(Assets::backgrounds[menuBgIdx]);
 }
 
-void render(float deltaTime) {
+// alpha is how far we are between the last two simulation ticks
+void render(float deltaTime, float alpha) {
+    PROFILE_SCOPE("render");
     if (inMenu) {
         renderMenu();
     } else {
-        Game::update(deltaTime);
-
-        worldOrgY = screenHeight - (TILE_SIZE * Game::selectedMap->height);
+        worldOrgY = screenHeight - (TILE_SIZE * getSelectedMap().height);
 
         renderBackground();
         renderMap();
-        renderBullets();
-        renderSoldiers(Game::friendlies, false);
-        renderSoldiers(Game::enemies, true);
+        renderBullets(alpha);
+        renderSoldiers(Game::friendlies, false, alpha);
+        renderSoldiers(Game::enemies, true, alpha);
         renderHud();
     }
 
     if (debug) {
-        renderText(std::string("fps: ") + std::to_string(fps) + " deltaTime: " + std::to_string(deltaTime), Assets::defaultFont->font12, 10, 10, 0, C_BLACK);
-        std::string campaginstr = Game::selectedCampaign != Assets::campaigns.end() ? Game::selectedCampaign->nameNice : "(invalid)";
+        renderText(std::string("fps: ") + std::to_string(fps) + " deltaTime: " + std::to_string(deltaTime), getFont(Assets::defaultFont).font12, 10, 10, 0, C_BLACK);
+        std::string campaginstr = Game::selectedCampaign >= 0 ? Assets::campaigns[Game::selectedCampaign].nameNice : "(invalid)";
         std::string mapstr;
-        if (Game::selectedCampaign != Assets::campaigns.end())
-            mapstr = Game::selectedMap != Game::selectedCampaign->maps.end() ? Game::selectedMap->name : "(invalid)";
+        if (Game::selectedCampaign >= 0)
+            mapstr = Game::selectedMap >= 0 ? getSelectedMap().name : "(invalid)";
         else mapstr = "(invalid)";
-        renderText(std::string("campaign: ") + campaginstr, Assets::defaultFont->font12, 10, 24, 0, C_BLACK);
-        renderText(std::string("map: ") + mapstr, Assets::defaultFont->font12, 10, 38, 0, C_BLACK);
+        renderText(std::string("campaign: ") + campaginstr, getFont(Assets::defaultFont).font12, 10, 24, 0, C_BLACK);
+        renderText(std::string("map: ") + mapstr, getFont(Assets::defaultFont).font12, 10, 38, 0, C_BLACK);
 
-        std::string friendlystr = Game::friendlyFaction != Assets::factions.end() ? Game::friendlyFaction->nameNice : "(invalid)";
-        std::string enemystr = Game::enemyFaction != Assets::factions.end() ? Game::enemyFaction->nameNice : "(invalid)";
-        renderText(std::string("friendly: ") + friendlystr, Assets::defaultFont->font12, 10, 52, 0, C_BLACK);
-        renderText(std::string("enemy: ") + enemystr, Assets::defaultFont->font12, 10, 66, 0, C_BLACK);
+        std::string friendlystr = Game::friendlyFaction >= 0 ? getFaction(Game::friendlyFaction).nameNice : "(invalid)";
+        std::string enemystr = Game::enemyFaction >= 0 ? getFaction(Game::enemyFaction).nameNice : "(invalid)";
+        renderText(std::string("friendly: ") + friendlystr, getFont(Assets::defaultFont).font12, 10, 52, 0, C_BLACK);
+        renderText(std::string("enemy: ") + enemystr, getFont(Assets::defaultFont).font12, 10, 66, 0, C_BLACK);
 
 	    renderText(std::string("friendlies: ") + std::to_string(Game::friendlies.size())
             + ", casualties " + std::to_string(Game::friendlyCasualties)
-            + ", holding " + std::to_string(Game::friendliesHoldingbjective), Assets::defaultFont->font12, 10, 80, 0, C_BLACK);
+            + ", holding " + std::to_string(Game::friendliesHoldingbjective), getFont(Assets::defaultFont).font12, 10, 80, 0, C_BLACK);
 	    renderText(std::string("enemies: ") + std::to_string(Game::enemies.size())
             + ", casualties " + std::to_string(Game::enemyCasualties)
-            + ", holding " + std::to_string(Game::enemiesHoldingObjective), Assets::defaultFont->font12, 10, 94, 0, C_BLACK);
+            + ", holding " + std::to_string(Game::enemiesHoldingObjective), getFont(Assets::defaultFont).font12, 10, 94, 0, C_BLACK);
     }
 }
 
+// performance panel, F3 toggles it. Keeps how long the last perfFrames frames
+// spent in each stage and draws their percentiles and a stacked graph on top
+bool perfHud = false;
+constexpr int perfFrames = 240;
+
+struct FrameTiming {
+    float frame, update, render, present;   // ms
+    int ticks, drawCalls;
+};
+
+FrameTiming perfTimings[perfFrames] = { };
+long perfFrame = 0;     // frames recorded, the newest is at (perfFrame - 1) % perfFrames
+SpriteBatch perfGraph;  // untextured quads
+
+void perfRecord(const FrameTiming& timing) {
+    perfTimings[perfFrame++ % perfFrames] = timing;
+}
+
+float percentile(std::vector<float>& values, float p) {
+    size_t n = std::min(values.size() - 1, size_t(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+void perfQuad(float x, float y, float w, float h, SDL_Color color) {
+    int base = perfGraph.vertices.size();
+    perfGraph.vertices.push_back({ { x, y }, color, { 0.0f, 0.0f } });
+    perfGraph.vertices.push_back({ { x + w, y }, color, { 0.0f, 0.0f } });
+    perfGraph.vertices.push_back({ { x + w, y + h }, color, { 0.0f, 0.0f } });
+    perfGraph.vertices.push_back({ { x, y + h }, color, { 0.0f, 0.0f } });
+    for (int i : { 0, 1, 2, 2, 3, 0 }) perfGraph.indices.push_back(base + i);
+}
+
+void renderPerfHud() {
+    int frames = std::min<long>(perfFrame, perfFrames);
+    if (frames == 0) return;
+
+    const int barWidth = 2, graphHeight = 100, rowHeight = 14;
+    const float graphMs = 40.0f;    // top of the graph
+    int panelWidth = perfFrames * barWidth + 20;
+    int panelX = screenWidth - panelWidth - 10, panelY = 10;
+    int graphY = panelY + 10 + 6 * rowHeight + 10;
+    SDL_Color colors[] = { { 160, 160, 160, 255 }, { 80, 140, 255, 255 }, { 80, 220, 80, 255 }, { 255, 160, 40, 255 } };
+
+    // background, graph and reference lines in one draw
+    perfGraph.vertices.clear();
+    perfGraph.indices.clear();
+    perfQuad(panelX, panelY, panelWidth, graphY + graphHeight + 10 - panelY, { 0, 0, 0, 180 });
+    for (int i = 0; i < frames; i++) {
+        const FrameTiming& t = perfTimings[(perfFrame - frames + i) % perfFrames];
+        float x = panelX + 10 + (perfFrames - frames + i) * barWidth;
+        float bottom = graphY + graphHeight;
+        float scale = graphHeight / graphMs;
+        // whole frame behind, the stages stacked on it
+        perfQuad(x, bottom - std::min(t.frame, graphMs) * scale, barWidth, std::min(t.frame, graphMs) * scale, colors[0]);
+        for (int stage = 1; stage < 4; stage++) {
+            float ms = stage == 1 ? t.update : stage == 2 ? t.render : t.present;
+            float h = std::min(ms * scale, bottom - graphY);
+            bottom -= h;
+            perfQuad(x, bottom, barWidth, h, colors[stage]);
+        }
+    }
+    for (float ms : { 1000.0f / 60.0f, 1000.0f / 30.0f })
+        perfQuad(panelX + 10, graphY + graphHeight - ms * graphHeight / graphMs, perfFrames * barWidth, 1, { 255, 255, 255, 160 });
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    drawCalls++;
+    if (SDL_RenderGeometry(renderer, NULL, perfGraph.vertices.data(), perfGraph.vertices.size(), perfGraph.indices.data(), perfGraph.indices.size()) < 0)
+        error_sdl("SDL_RenderGeometry failed");
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+    // percentiles per stage
+    TTF_Font *font = getFont(Assets::defaultFont).font12;
+    SDL_Color white = C_WHITE;
+    const char *names[] = { "frame", "update", "render", "present" };
+    int columns[] = { 0, 70, 140, 210, 280, 350 };
+    int y = panelY + 10;
+    const char *header[] = { "ms", "avg", "p50", "p95", "p99", "max" };
+    for (int c = 0; c < 6; c++) renderText(header[c], font, panelX + 10 + columns[c], y, 0, white);
+
+    std::vector<float> values(frames);
+    for (int stage = 0; stage < 4; stage++) {
+        float sum = 0.0f;
+        for (int i = 0; i < frames; i++) {
+            const FrameTiming& t = perfTimings[i];
+            values[i] = stage == 0 ? t.frame : stage == 1 ? t.update : stage == 2 ? t.render : t.present;
+            sum += values[i];
+        }
+        float stats[] = { sum / frames, percentile(values, 0.5f), percentile(values, 0.95f), percentile(values, 0.99f), *std::max_element(values.begin(), values.end()) };
+
+        y += rowHeight;
+        renderText(names[stage], font, panelX + 10, y, 0, colors[stage]);
+        for (int c = 0; c < 5; c++) {
+            char text[16];
+            snprintf(text, sizeof(text), "%.2f", stats[c]);
+            renderText(text, font, panelX + 10 + columns[c + 1], y, 0, white);
+        }
+    }
+
+    const FrameTiming& last = perfTimings[(perfFrame - 1) % perfFrames];
+    y += rowHeight;
+    renderText("bullets " + std::to_string(Game::bullets.size()) + "  friendlies " + std::to_string(Game::friendlies.size())
+        + "  enemies " + std::to_string(Game::enemies.size()) + "  ticks " + std::to_string(last.ticks)
+        + "  draw calls " + std::to_string(last.drawCalls), font, panelX + 10, y, 0, white);
+}
+
 // public functions
 void Renderer::loop() {
     std::cout << "Running render loop..." << std::endl;
@@ -383,31 +694,73 @@ void Renderer::loop() {
         auto time_now = std::chrono::high_resolution_clock::now();
         float deltaTime = (time_now - time_prev).count() / 1000000000.0f;
         fps = (deltaTime > 0.0f) ? 1.0f / deltaTime : 1.0f;
-        anim_div = std::roundl(fps / (float)ANIM_FPS);
-        if (anim_div == 0.0f) anim_div = 1.0;
         time_prev = time_now;
-        if (frameCounter > anim_div) { frameCounter = 0; }
 
         while (SDL_PollEvent(&event)) {
             switch (event.type) {
                 case SDL_KEYDOWN: {
-                    if (inMenu) menuKeyHandler(event.key.keysym.sym);
+                    if (event.key.keysym.sym == SDLK_F3) perfHud = !perfHud;
+                    else if (inMenu) menuKeyHandler(event.key.keysym.sym);
                     else gameKeyHandler(event.key.keysym.sym);
                 } break;
                 case SDL_QUIT: {
                     run = false;
                 } break;
+                // some backends drop render target contents, bake again
+                case SDL_RENDER_TARGETS_RESET: {
+                    if (!inMenu) bakeTerrain();
+                } break;
             }
         }
 
         SDL_GetWindowSize(window, &screenWidth, &screenHeight);
 
-        render(deltaTime);
+        // fixed timestep simulation, a slow frame runs several ticks
+        float tickTime = 1.0f / Game::tickRate;
+        float alpha = 1.0f;
+        int ticks = 0;
+        auto time_update = std::chrono::high_resolution_clock::now();
+        if (!inMenu) {
+            tickAccumulator += std::min(deltaTime, 0.25f);  // don't spiral after a stall
+            while (tickAccumulator >= tickTime) {
+                Game::update(tickTime);
+                tickAccumulator -= tickTime;
+                ticks++;
+            }
+            alpha = tickAccumulator / tickTime;
+            Audio::setViewport(-worldOrgX, screenWidth);
+            Audio::update();
+        }
+
+        auto time_render = std::chrono::high_resolution_clock::now();
+        drawCalls = 0;
+        render(deltaTime, alpha);
+        auto time_rendered = std::chrono::high_resolution_clock::now();
+        int sceneDrawCalls = drawCalls;
+        if (perfHud) renderPerfHud();
+        auto time_present = std::chrono::high_resolution_clock::now();
+
+        if (!run) break;
+        {
+            PROFILE_SCOPE("SDL_RenderPresent");
+            SDL_RenderPresent(renderer);
+        }
+        auto time_end = std::chrono::high_resolution_clock::now();
+
+        // the panel itself is left out of the render time and draw calls
+        auto ms = [](auto d) { return std::chrono::duration<float, std::milli>(d).count(); };
+        perfRecord({ deltaTime * 1000.0f, ms(time_render - time_update), ms(time_rendered - time_render), ms(time_end - time_present), ticks, sceneDrawCalls });
 
-        if (!run) return;
-        SDL_RenderPresent(renderer);
+        if (maxFps > 0) {
+            float frameTime = (std::chrono::high_resolution_clock::now() - time_now).count() / 1000000000.0f;
+            if (frameTime < 1.0f / maxFps) SDL_Delay((1.0f / maxFps - frameTime) * 1000.0f);
+        }
+    }
 
-        frameCounter++;
+    // leaving the match
+    if (!inMenu) {
+        destroyTerrain();
+        Game::mapTeardown();
     }
 }
 
@@ -434,9 +787,13 @@ void Renderer::initSDL() {
 
     if (Mix_OpenAudio(48000, MIX_DEFAULT_FORMAT, 2, 1024) < 0)
         exit_error_sdl("Mix_OpenAudio failed");
+    Audio::init();
 }
 
 void Renderer::destroySDL() {
+    destroyTerrain();
+    destroyGlyphAtlases();
+    Audio::destroy();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
@@ -0,0 +1,175 @@
+/*
+    ww1game:    Generic WW1 game (?)
+    pack.cpp:   Asset bundle packer (ww1game-pack)
+
+    Copyright (C) 2022 Ángel Ruiz Fernandez
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../src/main.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+// pngs are stored decoded as tightly packed RGBA32, everything else as is
+bool decodeImage(const std::filesystem::path& path, Bundle::Entry& entry, std::vector<uint8_t>& data) {
+    SDL_Surface *loaded = IMG_Load(path.string().c_str());
+    if (loaded == NULL) return false;
+    SDL_Surface *surf = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (surf == NULL) return false;
+
+    entry.type = Bundle::Entry::IMAGE;
+    entry.width = surf->w;
+    entry.height = surf->h;
+    data.resize(size_t(surf->w) * surf->h * 4);
+    for (int y = 0; y < surf->h; y++)
+        std::memcpy(data.data() + size_t(y) * surf->w * 4, (uint8_t*)surf->pixels + size_t(y) * surf->pitch, surf->w * 4);
+    SDL_FreeSurface(surf);
+    return true;
+}
+
+std::vector<std::string> textLines(const std::vector<uint8_t>& data) {
+    std::vector<std::string> lines;
+    std::istringstream stream(std::string(data.begin(), data.end()));
+    std::string line;
+    while (std::getline(stream, line))
+        lines.push_back(line);
+    return lines;
+}
+
+// properties.cfg and maps are stored parsed, what doesn't parse is stored as
+// text for the loader to report
+bool parseProperties(const std::vector<uint8_t>& text, Bundle::Entry& entry, std::vector<uint8_t>& data) {
+    Bundle::Properties properties;
+    if (!Bundle::parseProperties(textLines(text), properties)) return false;
+    entry.type = Bundle::Entry::PROPERTIES;
+    data.resize(sizeof(properties));
+    std::memcpy(data.data(), &properties, sizeof(properties));
+    return true;
+}
+
+bool parseMap(const std::vector<uint8_t>& text, Bundle::Entry& entry, std::vector<uint8_t>& data) {
+    std::vector<std::string> lines = textLines(text);
+    if (lines.size() <= Bundle::mapHeaderLines) return false;
+    for (int i = 0; i < Bundle::mapHeaderLines; i++)
+        if (lines[i].find('\0') != std::string::npos) return false;
+
+    Assets::Map map { };
+    map.name = lines[0];
+    map.terrainVariantName = lines[1];
+    map.backgroundName = lines[2];
+    map.friendlyFactionName = lines[3];
+    map.enemyFactionName = lines[4];
+    map.map.assign(lines.begin() + Bundle::mapHeaderLines, lines.end());
+    map.width = map.map[0].length();
+    map.height = map.map.size();
+    if (map.width == 0) return false;
+    for (const std::string& row : map.map)
+        if (row.length() != size_t(map.width)) return false;
+
+    Bundle::packMap(map, entry, data);
+    return true;
+}
+
+void pad(std::ofstream& out, size_t alignment) {
+    while (out.tellp() % alignment) out.put('\0');
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        std::cout << "Usage: " << argv[0] << " <asset directory> [output]" << std::endl
+            << "Packs the asset tree into one file, by default <asset directory>/" << BUNDLE_FILENAME << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path assetPath = argv[1];
+    std::filesystem::path outPath = argc == 3 ? std::filesystem::path(argv[2]) : assetPath / BUNDLE_FILENAME;
+    if (!std::filesystem::is_directory(assetPath)) exit_error("Asset directory " + assetPath.string() + " does not exist");
+
+    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) exit_error_img("IMG_Init failed");
+
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(assetPath)) {
+        if (!entry.is_regular_file()) continue;
+        if (entry.path().filename() == BUNDLE_FILENAME) continue;
+        if (std::filesystem::exists(outPath) && std::filesystem::equivalent(entry.path(), outPath)) continue;
+        files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) exit_error("Could not open " + outPath.string() + " for writing");
+
+    Bundle::Header header { };
+    std::memcpy(header.magic, Bundle::magic, sizeof(header.magic));
+    header.version = Bundle::version;
+    header.entryCount = files.size();
+    out.write((const char*)&header, sizeof(header));
+
+    std::vector<Bundle::Entry> entries;
+    std::string names;
+    size_t images = 0, parsed = 0;
+    for (const std::filesystem::path& file : files) {
+        Bundle::Entry entry { };
+        std::vector<uint8_t> data;
+        if (file.extension() == ".png" && decodeImage(file, entry, data)) {
+            images++;
+        } else {
+            if (file.extension() == ".png") error_img("IMG_Load failed on " + file.string() + ", stored undecoded");
+            std::ifstream in(file, std::ios::binary);
+            std::vector<uint8_t> text(std::istreambuf_iterator<char>(in), (std::istreambuf_iterator<char>()));
+            if ((file.filename() == "properties.cfg" && parseProperties(text, entry, data))
+                || (file.extension() == ".map" && parseMap(text, entry, data))) {
+                parsed++;
+            } else {
+                if (file.filename() == "properties.cfg" || file.extension() == ".map")
+                    warning("Could not parse " + file.string() + ", stored as text");
+                data = std::move(text);
+                entry.type = Bundle::Entry::FILE;
+            }
+        }
+
+        std::string name = std::filesystem::relative(file, assetPath).generic_string();
+        entry.nameOffset = names.size();
+        entry.nameLength = name.size();
+        names += name;
+
+        pad(out, 16);
+        entry.offset = out.tellp();
+        entry.size = data.size();
+        entry.hash = hashBytes(data.data(), data.size());
+        out.write((const char*)data.data(), data.size());
+        entries.push_back(entry);
+    }
+
+    pad(out, 16);
+    header.indexOffset = out.tellp();
+    out.write((const char*)entries.data(), entries.size() * sizeof(Bundle::Entry));
+    out.write(names.data(), names.size());
+
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.close();
+    if (!out) exit_error("Error writing " + outPath.string());
+
+    std::cout << "Packed " << files.size() << " files (" << images << " decoded images, " << parsed << " parsed maps and properties) into " << outPath.string()
+        << ", " << std::filesystem::file_size(outPath) / 1024 << " KiB" << std::endl;
+
+    IMG_Quit();
+    return 0;
+}